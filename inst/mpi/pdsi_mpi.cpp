@@ -0,0 +1,408 @@
+// pdsi_mpi calculates the monthly (sc)PDSI of a grid on many processes with
+// MPI, e.g. across the nodes of a cluster.  The cells are split into tiles
+// of consecutive cells, which rank 0 hands out to the other ranks one at a
+// time as they ask for them.  Each rank reads the input of its tile, runs
+// pdsi_run_batch on it and writes the results into output files shared by
+// all ranks.  See README.md for the file formats.
+#include <mpi.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "pdsi_batch.h"
+
+// Messages between the workers and rank 0
+#define TAG_READY 1  // worker: int[2], tiles done, cells failed in the last
+#define TAG_TILE 2   // rank 0: int, the tile to calculate, -1 when done
+
+// The outputs, one file each in the output directory
+enum { O_X, O_PHDI, O_WPLM, O_Z, O_CLIM, O_CALIB, O_STATUS, N_OUT };
+static const char *out_names[N_OUT] = {
+  "X.bin", "PHDI.bin", "WPLM.bin", "Z.bin", "clim_coes.bin",
+  "calib_coes.bin", "status.bin"
+};
+
+struct mpi_run {
+  // Settings
+  const char *P_file;
+  const char *PE_file;
+  const char *AWC_file;   // AWC of each cell, or NULL to use AWC
+  const char *out_dir;
+  number AWC;
+  int s_yr, e_yr;
+  int calib_s_yr, calib_e_yr;
+  int nmon;               // months of input of each cell
+  bool sc;
+  int tile;               // cells of a tile
+  int threads;            // threads of each rank
+  number K1_1, K1_2, K1_3, K2, p, q;  // the coefficients, as in pdsi()
+  int calib_iter;         // passes of the self-calibration
+  number calib_tol;
+
+  // Set up by mpi_open
+  long ncell;
+  int ntiles;
+  int np;                 // months of output of each cell
+  MPI_File P, PE, AWC_in;
+  MPI_File out[N_OUT];
+};
+
+static void mpi_fail(const char *fmt, const char *what) {
+  fprintf(stderr, "pdsi_mpi: ");
+  fprintf(stderr, fmt, what);
+  fprintf(stderr, "\n");
+  MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+static void mpi_usage() {
+  fprintf(stderr,
+    "usage: pdsi_mpi -p P.bin -e PE.bin -s start -E end -o outdir\n"
+    "                [-a AWC | -A AWC.bin] [-c cal_start] [-C cal_end]\n"
+    "                [-m months] [-n] [-k K1_1,K1_2,K1_3,K2,p,q]\n"
+    "                [-i iter] [-T tol] [-t cells] [-j threads]\n"
+    "  -p, -e  monthly P and PE, doubles, months x cells, column-major\n"
+    "  -s, -E  the first and last year to calculate\n"
+    "  -o      directory of the outputs, created if needed\n"
+    "  -a      AWC of every cell (100), or -A a file of one double per cell\n"
+    "  -c, -C  calibrating years (start to end)\n"
+    "  -m      months of input of each cell ((end - start + 1) * 12)\n"
+    "  -n      the conventional PDSI instead of the scPDSI\n"
+    "  -k      the coefficients (1.5,2.8,0.5,17.67,0.897,0.3333...)\n"
+    "  -i      passes of the self-calibration (3)\n"
+    "  -T      tolerance of the ratios to stop it early, 0 for none (0)\n"
+    "  -t      cells of a tile (1024)\n"
+    "  -j      threads of each rank, every core when 0 (1)\n");
+}
+
+static MPI_File mpi_open_file(const std::string &name, int mode) {
+  MPI_File f;
+  if(MPI_File_open(MPI_COMM_WORLD, name.c_str(), mode, MPI_INFO_NULL, &f) !=
+     MPI_SUCCESS)
+    mpi_fail("cannot open %s.", name.c_str());
+  return f;
+}
+
+// Opens the inputs and outputs on every rank and works out the size of the
+// grid from that of P.
+static void mpi_open(mpi_run &r, int rank) {
+  MPI_Offset size_P, size_PE;
+
+  r.P = mpi_open_file(r.P_file, MPI_MODE_RDONLY);
+  r.PE = mpi_open_file(r.PE_file, MPI_MODE_RDONLY);
+  MPI_File_get_size(r.P, &size_P);
+  MPI_File_get_size(r.PE, &size_PE);
+  if(size_P != size_PE)
+    mpi_fail("%s is not the size of P.", r.PE_file);
+  MPI_Offset cell = (MPI_Offset)r.nmon * sizeof(number);
+  if(size_P == 0 || size_P % cell != 0)
+    mpi_fail("%s is not a whole number of cells of the months given.",
+             r.P_file);
+  r.ncell = (long)(size_P / cell);
+  r.ntiles = (int)((r.ncell + r.tile - 1) / r.tile);
+
+  r.AWC_in = MPI_FILE_NULL;
+  if(r.AWC_file) {
+    MPI_Offset size_AWC;
+    r.AWC_in = mpi_open_file(r.AWC_file, MPI_MODE_RDONLY);
+    MPI_File_get_size(r.AWC_in, &size_AWC);
+    if(size_AWC != (MPI_Offset)r.ncell * (MPI_Offset)sizeof(number))
+      mpi_fail("%s does not hold one value for each cell.", r.AWC_file);
+  }
+
+  if(rank == 0 && mkdir(r.out_dir, 0777) != 0 && errno != EEXIST)
+    mpi_fail("cannot create %s.", r.out_dir);
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  // the full size is set at once, so that the tiles can be written in any
+  // order
+  const MPI_Offset series = r.np * sizeof(number);
+  const MPI_Offset per_cell[N_OUT] = {
+    series, series, series, series,
+    60 * sizeof(number), 10 * sizeof(number), 3 * sizeof(int)
+  };
+  for(int o = 0; o < N_OUT; o++) {
+    std::string name = std::string(r.out_dir) + "/" + out_names[o];
+    r.out[o] = mpi_open_file(name, MPI_MODE_CREATE | MPI_MODE_WRONLY);
+    MPI_File_set_size(r.out[o], per_cell[o] * r.ncell);
+  }
+}
+
+static void mpi_close(mpi_run &r) {
+  MPI_File_close(&r.P);
+  MPI_File_close(&r.PE);
+  if(r.AWC_in != MPI_FILE_NULL)
+    MPI_File_close(&r.AWC_in);
+  for(int o = 0; o < N_OUT; o++)
+    MPI_File_close(&r.out[o]);
+}
+
+static void mpi_read(MPI_File f, MPI_Offset off, number *buf, size_t n,
+                     const char *name) {
+  MPI_Status st;
+  if(MPI_File_read_at(f, off * (MPI_Offset)sizeof(number), buf, (int)n,
+                      MPI_DOUBLE, &st) != MPI_SUCCESS)
+    mpi_fail("cannot read %s.", name);
+}
+
+static void mpi_write(MPI_File f, MPI_Offset off, const void *buf, size_t n,
+                      MPI_Datatype type, const char *name) {
+  MPI_Status st;
+  int size;
+  MPI_Type_size(type, &size);
+  if(MPI_File_write_at(f, off * size, buf, (int)n, type, &st) !=
+     MPI_SUCCESS)
+    mpi_fail("cannot write %s.", name);
+}
+
+// The workspace of a rank, sized for a full tile
+struct mpi_tile {
+  std::vector<number> P, PE, AWC;
+  std::vector<int> calib_s_yr, calib_e_yr;
+  std::vector<number> X, PHDI, WPLM, Z, clim_coes, calib_coes;
+  std::vector<int> iters, status, warnings, codes;
+};
+
+// Calculates tile t and writes its results.  Returns the number of cells
+// that failed.
+static int mpi_run_tile(const mpi_run &r, mpi_tile &w, int t) {
+  long first = (long)t * r.tile;
+  int n = (int)min((long)r.tile, r.ncell - first);
+
+  mpi_read(r.P, (MPI_Offset)first * r.nmon, &w.P[0], (size_t)n * r.nmon,
+           r.P_file);
+  mpi_read(r.PE, (MPI_Offset)first * r.nmon, &w.PE[0], (size_t)n * r.nmon,
+           r.PE_file);
+  if(r.AWC_file)
+    mpi_read(r.AWC_in, first, &w.AWC[0], n, r.AWC_file);
+
+  pdsi_batch b;
+  b.P = &w.P[0];
+  b.PE = &w.PE[0];
+  b.nmon = r.nmon;
+  b.nst = n;
+  b.shared_input = false;
+  b.AWC = &w.AWC[0];
+  b.calib_s_yr = &w.calib_s_yr[0];
+  b.calib_e_yr = &w.calib_e_yr[0];
+  b.s_yr = r.s_yr;
+  b.e_yr = r.e_yr;
+  b.sc = r.sc;
+  b.K1_1 = r.K1_1;
+  b.K1_2 = r.K1_2;
+  b.K1_3 = r.K1_3;
+  b.K2 = r.K2;
+  b.p = r.p;
+  b.q = r.q;
+  b.calib_iter = r.calib_iter;
+  b.calib_tol = r.calib_tol;
+  b.np = r.np;
+  b.X = &w.X[0];
+  b.PHDI = &w.PHDI[0];
+  b.WPLM = &w.WPLM[0];
+  b.Z = &w.Z[0];
+  b.clim_coes = &w.clim_coes[0];
+  b.calib_coes = &w.calib_coes[0];
+  b.iters = &w.iters[0];
+  b.status = &w.status[0];
+  b.warnings = &w.warnings[0];
+
+  int failed = pdsi_run_batch(b, r.threads);
+
+  for(int i = 0; i < n; i++) {
+    w.codes[3 * i] = w.status[i];
+    w.codes[3 * i + 1] = w.warnings[i];
+    w.codes[3 * i + 2] = w.iters[i];
+  }
+  MPI_Offset cells = first;
+  mpi_write(r.out[O_X], cells * r.np, &w.X[0], (size_t)n * r.np,
+            MPI_DOUBLE, out_names[O_X]);
+  mpi_write(r.out[O_PHDI], cells * r.np, &w.PHDI[0], (size_t)n * r.np,
+            MPI_DOUBLE, out_names[O_PHDI]);
+  mpi_write(r.out[O_WPLM], cells * r.np, &w.WPLM[0], (size_t)n * r.np,
+            MPI_DOUBLE, out_names[O_WPLM]);
+  mpi_write(r.out[O_Z], cells * r.np, &w.Z[0], (size_t)n * r.np,
+            MPI_DOUBLE, out_names[O_Z]);
+  mpi_write(r.out[O_CLIM], cells * 60, &w.clim_coes[0], (size_t)n * 60,
+            MPI_DOUBLE, out_names[O_CLIM]);
+  mpi_write(r.out[O_CALIB], cells * 10, &w.calib_coes[0], (size_t)n * 10,
+            MPI_DOUBLE, out_names[O_CALIB]);
+  mpi_write(r.out[O_STATUS], cells * 3, &w.codes[0], (size_t)n * 3,
+            MPI_INT, out_names[O_STATUS]);
+  return failed;
+}
+
+static void mpi_tile_alloc(const mpi_run &r, mpi_tile &w) {
+  size_t in = (size_t)r.tile * r.nmon, out = (size_t)r.tile * r.np;
+  try {
+    w.P.resize(in);
+    w.PE.resize(in);
+    w.AWC.assign(r.tile, r.AWC);
+    w.calib_s_yr.assign(r.tile, r.calib_s_yr);
+    w.calib_e_yr.assign(r.tile, r.calib_e_yr);
+    w.X.resize(out);
+    w.PHDI.resize(out);
+    w.WPLM.resize(out);
+    w.Z.resize(out);
+    w.clim_coes.resize((size_t)r.tile * 60);
+    w.calib_coes.resize((size_t)r.tile * 10);
+    w.iters.resize(r.tile);
+    w.status.resize(r.tile);
+    w.warnings.resize(r.tile);
+    w.codes.resize((size_t)r.tile * 3);
+  } catch(std::bad_alloc &) {
+    mpi_fail("%s", "not enough memory for a tile, try a smaller -t.");
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Rank 0 hands out the tiles in order, each to the first worker that asks
+// for one, so that a rank that gets slow tiles (fewer missing months, a
+// slower node) simply takes fewer of them.  It calculates nothing itself
+// unless it is the only rank.
+//-----------------------------------------------------------------------------
+static void mpi_master(const mpi_run &r, int nranks, long &failed,
+                       std::vector<int> &done) {
+  int next = 0, active = nranks - 1;
+  int msg[2];
+  MPI_Status st;
+
+  while(active > 0) {
+    MPI_Recv(msg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_READY, MPI_COMM_WORLD, &st);
+    done[st.MPI_SOURCE] = msg[0];
+    failed += msg[1];
+
+    int t = next < r.ntiles ? next++ : -1;
+    if(t < 0)
+      active--;
+    MPI_Send(&t, 1, MPI_INT, st.MPI_SOURCE, TAG_TILE, MPI_COMM_WORLD);
+  }
+}
+
+static void mpi_worker(const mpi_run &r) {
+  mpi_tile w;
+  int msg[2] = {0, 0};
+  int t;
+
+  mpi_tile_alloc(r, w);
+  for(;;) {
+    MPI_Send(msg, 2, MPI_INT, 0, TAG_READY, MPI_COMM_WORLD);
+    MPI_Recv(&t, 1, MPI_INT, 0, TAG_TILE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if(t < 0)
+      break;
+    msg[1] = mpi_run_tile(r, w, t);
+    msg[0]++;
+  }
+}
+
+int main(int argc, char **argv) {
+  int rank, nranks;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  mpi_run r;
+  memset(&r, 0, sizeof(r));
+  r.AWC = 100;
+  r.s_yr = r.e_yr = r.calib_s_yr = r.calib_e_yr = -1;
+  r.sc = true;
+  r.tile = 1024;
+  r.threads = 1;
+  // the defaults of the options of the package
+  r.K1_1 = 1.5;
+  r.K1_2 = 2.8;
+  r.K1_3 = 0.5;
+  r.K2 = 17.67;
+  r.p = 0.897;
+  r.q = 1.0 / 3;
+  r.calib_iter = 3;
+  r.calib_tol = 0;
+
+  int c;
+  while((c = getopt(argc, argv, "p:e:s:E:o:a:A:c:C:m:nk:i:T:t:j:h")) != -1) {
+    switch(c) {
+    case 'p': r.P_file = optarg; break;
+    case 'e': r.PE_file = optarg; break;
+    case 's': r.s_yr = atoi(optarg); break;
+    case 'E': r.e_yr = atoi(optarg); break;
+    case 'o': r.out_dir = optarg; break;
+    case 'a': r.AWC = atof(optarg); break;
+    case 'A': r.AWC_file = optarg; break;
+    case 'c': r.calib_s_yr = atoi(optarg); break;
+    case 'C': r.calib_e_yr = atoi(optarg); break;
+    case 'm': r.nmon = atoi(optarg); break;
+    case 'n': r.sc = false; break;
+    case 'k':
+      if(sscanf(optarg, "%lf,%lf,%lf,%lf,%lf,%lf", &r.K1_1, &r.K1_2, &r.K1_3,
+                &r.K2, &r.p, &r.q) != 6)
+        mpi_fail("%s", "-k takes the six values K1_1,K1_2,K1_3,K2,p,q.");
+      break;
+    case 'i': r.calib_iter = atoi(optarg); break;
+    case 'T': r.calib_tol = atof(optarg); break;
+    case 't': r.tile = atoi(optarg); break;
+    case 'j': r.threads = atoi(optarg); break;
+    default:
+      if(rank == 0)
+        mpi_usage();
+      MPI_Finalize();
+      return c == 'h' ? 0 : 2;
+    }
+  }
+  if(!r.P_file || !r.PE_file || !r.out_dir || r.s_yr < 0 || r.e_yr < 0) {
+    if(rank == 0)
+      mpi_usage();
+    MPI_Finalize();
+    return 2;
+  }
+  if(r.s_yr >= r.e_yr)
+    mpi_fail("%s", "the start year must be earlier than the end year.");
+  if(r.calib_s_yr < 0)
+    r.calib_s_yr = r.s_yr;
+  if(r.calib_e_yr < 0)
+    r.calib_e_yr = r.e_yr;
+  if(r.calib_iter < 1 || r.calib_tol < 0)
+    mpi_fail("%s", "-i must be at least 1 and -T not negative.");
+  r.np = (r.e_yr - r.s_yr + 1) * 12;
+  if(r.nmon <= 0)
+    r.nmon = r.np;
+  // the counts of the reads and writes of a tile are ints
+  if(r.tile < 1 || (double)r.tile * std::max(r.nmon, r.np) > 2147483647.0)
+    mpi_fail("%s", "the tile size (-t) is out of range.");
+
+  mpi_open(r, rank);
+
+  double t0 = MPI_Wtime();
+  long failed = 0;
+  std::vector<int> done(nranks, 0);
+  if(nranks == 1) {
+    mpi_tile w;
+    mpi_tile_alloc(r, w);
+    for(int t = 0; t < r.ntiles; t++)
+      failed += mpi_run_tile(r, w, t);
+    done[0] = r.ntiles;
+  } else if(rank == 0) {
+    mpi_master(r, nranks, failed, done);
+  } else {
+    mpi_worker(r);
+  }
+
+  mpi_close(r);
+
+  if(rank == 0) {
+    printf("pdsi_mpi: %ld cells in %d tiles on %d ranks, %ld failed, "
+           "%.1f s\n", r.ncell, r.ntiles, nranks, failed, MPI_Wtime() - t0);
+    for(int i = 0; i < nranks; i++)
+      if(done[i] > 0)
+        printf("  rank %d: %d tiles\n", i, done[i]);
+  }
+  MPI_Finalize();
+  return failed > 0 ? 1 : 0;
+}
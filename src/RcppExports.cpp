@@ -6,8 +6,8 @@
 using namespace Rcpp;
 
 // C_pdsi
-List C_pdsi(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, bool sc, double K1_1, double K1_2, double K1_3, double K2, double p, double q);
-RcppExport SEXP _scPDSI_C_pdsi(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP scSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP, SEXP K2SEXP, SEXP pSEXP, SEXP qSEXP) {
+List C_pdsi(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, bool sc, double K1_1, double K1_2, double K1_3, double K2, double p, double q, int calib_iter, double calib_tol);
+RcppExport SEXP _scPDSI_C_pdsi(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP scSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP, SEXP K2SEXP, SEXP pSEXP, SEXP qSEXP, SEXP calib_iterSEXP, SEXP calib_tolSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -25,13 +25,168 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type K2(K2SEXP);
     Rcpp::traits::input_parameter< double >::type p(pSEXP);
     Rcpp::traits::input_parameter< double >::type q(qSEXP);
-    rcpp_result_gen = Rcpp::wrap(C_pdsi(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, sc, K1_1, K1_2, K1_3, K2, p, q));
+    Rcpp::traits::input_parameter< int >::type calib_iter(calib_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type calib_tol(calib_tolSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, sc, K1_1, K1_2, K1_3, K2, p, q, calib_iter, calib_tol));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_both
+List C_pdsi_both(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, double K1_1, double K1_2, double K1_3, double K2, double p, double q, int calib_iter, double calib_tol, bool parallel);
+RcppExport SEXP _scPDSI_C_pdsi_both(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP, SEXP K2SEXP, SEXP pSEXP, SEXP qSEXP, SEXP calib_iterSEXP, SEXP calib_tolSEXP, SEXP parallelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< double >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< double >::type K1_1(K1_1SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_2(K1_2SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_3(K1_3SEXP);
+    Rcpp::traits::input_parameter< double >::type K2(K2SEXP);
+    Rcpp::traits::input_parameter< double >::type p(pSEXP);
+    Rcpp::traits::input_parameter< double >::type q(qSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_iter(calib_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type calib_tol(calib_tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type parallel(parallelSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_both(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, K1_1, K1_2, K1_3, K2, p, q, calib_iter, calib_tol, parallel));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_batch
+List C_pdsi_batch(NumericMatrix P, NumericMatrix PE, NumericVector AWC, int s_yr, int e_yr, IntegerVector calib_s_yr, IntegerVector calib_e_yr, bool sc, double K1_1, double K1_2, double K1_3, double K2, double p, double q, int calib_iter, double calib_tol, int threads);
+RcppExport SEXP _scPDSI_C_pdsi_batch(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP scSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP, SEXP K2SEXP, SEXP pSEXP, SEXP qSEXP, SEXP calib_iterSEXP, SEXP calib_tolSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< bool >::type sc(scSEXP);
+    Rcpp::traits::input_parameter< double >::type K1_1(K1_1SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_2(K1_2SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_3(K1_3SEXP);
+    Rcpp::traits::input_parameter< double >::type K2(K2SEXP);
+    Rcpp::traits::input_parameter< double >::type p(pSEXP);
+    Rcpp::traits::input_parameter< double >::type q(qSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_iter(calib_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type calib_tol(calib_tolSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_batch(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, sc, K1_1, K1_2, K1_3, K2, p, q, calib_iter, calib_tol, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_sets
+List C_pdsi_sets(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, NumericMatrix sets);
+RcppExport SEXP _scPDSI_C_pdsi_sets(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP setsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< double >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type sets(setsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_sets(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, sets));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_mc
+List C_pdsi_mc(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, NumericMatrix sets, bool sc, int calib_iter, double calib_tol, NumericVector probs, int threads);
+RcppExport SEXP _scPDSI_C_pdsi_mc(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP setsSEXP, SEXP scSEXP, SEXP calib_iterSEXP, SEXP calib_tolSEXP, SEXP probsSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< double >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type sets(setsSEXP);
+    Rcpp::traits::input_parameter< bool >::type sc(scSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_iter(calib_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type calib_tol(calib_tolSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type probs(probsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_mc(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, sets, sc, calib_iter, calib_tol, probs, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_boot
+List C_pdsi_boot(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, int calib_s_yr, int calib_e_yr, double K1_1, double K1_2, double K1_3, double K2, double p, double q, int calib_iter, double calib_tol, IntegerMatrix years, int threads);
+RcppExport SEXP _scPDSI_C_pdsi_boot(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP, SEXP K2SEXP, SEXP pSEXP, SEXP qSEXP, SEXP calib_iterSEXP, SEXP calib_tolSEXP, SEXP yearsSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< double >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< double >::type K1_1(K1_1SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_2(K1_2SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_3(K1_3SEXP);
+    Rcpp::traits::input_parameter< double >::type K2(K2SEXP);
+    Rcpp::traits::input_parameter< double >::type p(pSEXP);
+    Rcpp::traits::input_parameter< double >::type q(qSEXP);
+    Rcpp::traits::input_parameter< int >::type calib_iter(calib_iterSEXP);
+    Rcpp::traits::input_parameter< double >::type calib_tol(calib_tolSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type years(yearsSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_boot(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, K1_1, K1_2, K1_3, K2, p, q, calib_iter, calib_tol, years, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// C_pdsi_clim_coes
+NumericVector C_pdsi_clim_coes(NumericVector P, NumericVector PE, double AWC, int s_yr, int e_yr, IntegerVector calib_s_yr, IntegerVector calib_e_yr, double K1_1, double K1_2, double K1_3);
+RcppExport SEXP _scPDSI_C_pdsi_clim_coes(SEXP PSEXP, SEXP PESEXP, SEXP AWCSEXP, SEXP s_yrSEXP, SEXP e_yrSEXP, SEXP calib_s_yrSEXP, SEXP calib_e_yrSEXP, SEXP K1_1SEXP, SEXP K1_2SEXP, SEXP K1_3SEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type P(PSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type PE(PESEXP);
+    Rcpp::traits::input_parameter< double >::type AWC(AWCSEXP);
+    Rcpp::traits::input_parameter< int >::type s_yr(s_yrSEXP);
+    Rcpp::traits::input_parameter< int >::type e_yr(e_yrSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type calib_s_yr(calib_s_yrSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type calib_e_yr(calib_e_yrSEXP);
+    Rcpp::traits::input_parameter< double >::type K1_1(K1_1SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_2(K1_2SEXP);
+    Rcpp::traits::input_parameter< double >::type K1_3(K1_3SEXP);
+    rcpp_result_gen = Rcpp::wrap(C_pdsi_clim_coes(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr, K1_1, K1_2, K1_3));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_scPDSI_C_pdsi", (DL_FUNC) &_scPDSI_C_pdsi, 14},
+    {"_scPDSI_C_pdsi", (DL_FUNC) &_scPDSI_C_pdsi, 16},
+    {"_scPDSI_C_pdsi_both", (DL_FUNC) &_scPDSI_C_pdsi_both, 16},
+    {"_scPDSI_C_pdsi_batch", (DL_FUNC) &_scPDSI_C_pdsi_batch, 17},
+    {"_scPDSI_C_pdsi_sets", (DL_FUNC) &_scPDSI_C_pdsi_sets, 8},
+    {"_scPDSI_C_pdsi_mc", (DL_FUNC) &_scPDSI_C_pdsi_mc, 13},
+    {"_scPDSI_C_pdsi_boot", (DL_FUNC) &_scPDSI_C_pdsi_boot, 17},
+    {"_scPDSI_C_pdsi_clim_coes", (DL_FUNC) &_scPDSI_C_pdsi_clim_coes, 10},
     {NULL, NULL, 0}
 };
 
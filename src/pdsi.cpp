@@ -6,6 +6,18 @@
 //#include <stdio.h>
 #include <ctype.h>
 
+// PDSI_NP_DISPATCH calls the instance of the template member function f for
+// the current number of periods per year.
+#define PDSI_NP_DISPATCH(f)                                                 \
+  switch(num_of_periods) {                                                  \
+  case 12: f<12>(); break;                                                  \
+  case 52: f<52>(); break;                                                  \
+  case 26: f<26>(); break;                                                  \
+  case 13: f<13>(); break;                                                  \
+  case 4: f<4>(); break;                                                    \
+  default:                                                                  \
+    status = PDSI_ERR_PERIODS;                                              \
+  }
 
 //=============================================================================
 //pdsi.cpp              University of Nebraska - Lincoln            Jul 15 2003
@@ -213,16 +225,60 @@ pdsi::pdsi() {
   nadss=0;
   setCalibrationStartYear=0;
   setCalibrationEndYear=0;
+
+  // Everything else starts from zero, so that nothing is read before it
+  // has been set.
+  Weekly = Monthly = SCMonthly = false;
+  status = PDSI_OK;
+  s_year = e_year = extra = south = 0;
+  startyear = endyear = totalyears = 0;
+  calibrationStartYear = calibrationEndYear = 0;
+  currentCalibrationStartYear = currentCalibrationEndYear = 0;
+  nStartYearsToSkip = nEndYearsToSkip = nCalibrationYears = 0;
+  nStartPeriodsToSkip = nEndPeriodsToSkip = nCalibrationPeriods = 0;
+  TLA = AWC = I = A = 0.0;
+  ET = R = L = RO = PE = PR = PL = PRO = Su = Ss = 0.0;
+  Phat = d = K = Z = 0.0;
+  drym = dryb = wetm = wetb = dry_ratio = wet_ratio = 0.0;
+  X1 = X2 = X3 = X = Prob = V = Q = 0.0;
+  DKSum = SD = SD2 = 0.0;
+  number *per_arrays[] = { TNorm, T, P, ETSum, RSum, LSum, ROSum, PESum,
+                           PRSum, PLSum, PROSum, PSum, Alpha, Beta, Gamma,
+                           Delta, D, k, DSSqr, DSAct, SPhat, DEPSum,
+                           coefs[0], coefs[1], coefs[2], coefs[3], coefs[4] };
+  for(unsigned int i = 0; i < sizeof(per_arrays) / sizeof(number*); i++)
+    std::fill(per_arrays[i], per_arrays[i] + 52, 0.0);
+  for(int i = 0; i < 10; i++) {
+    dur_length[i] = 0;
+    wet_Z_sum[i] = dry_Z_sum[i] = 0.0;
+  }
+
+  P_in = PE_in = NULL;
+  input_len = 0;
+  for(int i = 0; i < N_VALS; i++)
+    vals[i] = NULL;
+  nPeriods = nReservedPeriods = nValsPeriods = 0;
+  warnings = 0;
+  K_w = K_d = 1.0;
+  coe_K1_1 = coe_K1_2 = coe_K1_3 = coe_K2 = 0.0;
+  coe_p = coe_q = coe_m = coe_b = 0.0;
+  calib_max_iter = calib_iter = 0;
+  calib_tol = 0.0;
+  keep_year_sums = false;
 }
 //-----------------------------------------------------------------------------
-// The destructor deletes the temporary files used in storing various items
+// The destructor deleted the temporary files used in storing various items.
+// Nothing writes them any more, and removing files from the working
+// directory is not something a workspace should do.
 //-----------------------------------------------------------------------------
 pdsi::~pdsi() {
+  /*
   if(extra != 3 && extra != 9){
     remove("potentials");  // Used for storing potential values for later use
     remove("dvalue");  // Used to store the d values for use after summing them
   }
   remove("bigTable.tbl");
+   */
   /*
   if(verbose > 0)
     printf("Calculations Complete\n");
@@ -1116,6 +1172,7 @@ void pdsi::WeeklyPDSI() {
   if(verbose > 1)
     printf("\nCalibrating Index.\n");
   //calculate the duration factors
+  CalcZSums();
   CalcDurFact(wetm, wetb, 1);
   CalcDurFact(drym, dryb, -1);
   if(verbose>1) {
@@ -1392,6 +1449,7 @@ void pdsi::SCMonthlyPDSI() {
   if(verbose > 1)
     printf("\nCalibrating Index.\n");
   //calculate the duration factors
+  CalcZSums();
   CalcDurFact(wetm, wetb, 1);
   CalcDurFact(drym, dryb, -1);
   if(verbose>1) {
@@ -1920,7 +1978,8 @@ number pdsi::CalcThornA(number I) {
 // Note:  Phat is P with a ^ on it in the mathematical equations explaining
 // the Palmer Drought Index
 //-----------------------------------------------------------------------------
-void pdsi::Calcd() {
+template<int NP>
+void pdsi::CalcdNP() {
   //FILE *fin;        // File pointer for the temp. input file potentials
   //FILE *fout;       // File pointer for the temp. output file dvalue
   int per;           // The period in question
@@ -1932,13 +1991,15 @@ void pdsi::Calcd() {
   // These variables are used in calculating terminal outputs and are not
   // important to the final PDSI
   number D_sum[52];
-  number DSAct[52];
-  number SPhat[52];
 
   for(i=0;i<52;i++){
     D_sum[i] = 0.0;
-	  DSAct[i] = 0.0;
-	  SPhat[i] = 0.0;
+  }
+  if(pdsi_diagnostics) {
+    for(i=0;i<52;i++){
+      DSAct[i] = 0.0;
+      SPhat[i] = 0.0;
+    }
   }
 
   // The potentials file is opened for reading in the previously stored values
@@ -1962,16 +2023,15 @@ void pdsi::Calcd() {
   //  letter = fgetc(fin);
   // This reads in the values previously stored in "potentials"
   //while(fscanf(fin,"%d %d %f %f %f %f %f %f", &yr, &per, &scn1, &scn2, &scn3, &scn4, &scn5, &scn6) != EOF) {
-  for(i = 0; i < vals_mat.nrow(); i++) {
-    yr = vals_mat(i, 0);
-    per = vals_mat(i, 1);
-    per = (per-1)/period_length;   //adjust the period # for use in arrays.
-
-    p = vals_mat(i, 2);
-    PE = vals_mat(i, 3);
-    PR = vals_mat(i, 4);
-    PRO = vals_mat(i, 5);
-    PL = vals_mat(i, 6);
+  for(i = 0; i < nPeriods; i++) {
+    yr = i / NP + 1;
+    per = i % NP;
+
+    p = vals[V_P][i];
+    PE = vals[V_PE][i];
+    PR = vals[V_PR][i];
+    PRO = vals[V_PRO][i];
+    PL = vals[V_PL][i];
     //scn6 is P - PE, which can be ignored for calculations.
 
     if(p!=MISSING&&PE!=MISSING&&PR!=MISSING&&PRO!=MISSING&&PL!=MISSING){
@@ -1981,7 +2041,7 @@ void pdsi::Calcd() {
 
       // The values of d are output to a temp file for later use.
       //fprintf (fout, "%d %d %f\n", yr, (period_length*per)+1, d);
-      vals_mat(i, 7) = d;
+      vals[V_d][i] = d;
 
     /* SG 6/5/06: Need to only update statistical values when in
     **            user defined calibration interval. When not used
@@ -1998,14 +2058,16 @@ void pdsi::Calcd() {
 		      D_sum[per] += d;
 
         // The statistical values are updated
-        DSAct[per] += d;
-        DSSqr[per] += d*d;
-        SPhat[per] += Phat;
+        if(pdsi_diagnostics) {
+          DSAct[per] += d;
+          DSSqr[per] += d*d;
+          SPhat[per] += Phat;
+        }
       }
     }
     else {
       d = MISSING;
-      vals_mat(i, 7) = d;
+      vals[V_d][i] = d;
       //fprintf (fout, "%d %d %f\n", yr, (period_length*per)+1, d);
     }
   }
@@ -2018,7 +2080,7 @@ void pdsi::Calcd() {
     printf ("%9s %8s %8s\n\n", "SCL", "SCP", "SCD");
   }
    */
-  for(i = 0; i < num_of_periods; i++) {
+  for(i = 0; i < NP; i++) {
     //if(verbose>1) {
     //  printf ("%4d%9.2f%9.2f", (period_length*i)+1, Alpha[i]*PESum[i], Beta[i]*PRSum[i]);
     //  printf ("%9.2f%9.2f", Gamma[i]*PROSum[i], Delta[i]*PLSum[i]);
@@ -2035,16 +2097,20 @@ void pdsi::Calcd() {
   //fclose(fin);
   //fclose(fout);
 }// end of Calcd()
+void pdsi::Calcd() {
+  PDSI_NP_DISPATCH(CalcdNP);
+}
 //-----------------------------------------------------------------------------
 // This function uses previously calculated sums to find K, which is the
 // weighting factor used in the Palmer Index calculation.
 //-----------------------------------------------------------------------------
-void pdsi::CalcK() {
+template<int NP>
+void pdsi::CalcKNP() {
   number sums;        //used to calc k
 
   // Calculate k, which is K', or Palmer's second approximation of K
 
-  for(int per = 0; per < num_of_periods; per++){
+  for(int per = 0; per < NP; per++){
     if(PSum[per] + LSum[per] == 0)
       sums = 0;//prevent div by 0
     else
@@ -2055,19 +2121,22 @@ void pdsi::CalcK() {
     else
       k[per] = coe_K1_1 * log10((sums + coe_K1_2) / D[per]) + coe_K1_3;
 
-    coefs_mat(per, 4) = k[per];
+    coefs[4][per] = k[per];
   }
 
 }//end of CalcK()
+void pdsi::CalcK() {
+  PDSI_NP_DISPATCH(CalcKNP);
+}
 
 //-----------------------------------------------------------------------------
 // This function uses previously calculated sums to find K, which is the
 // original weighting factor used in the Palmer Index calculation.
 //-----------------------------------------------------------------------------
-void pdsi::CalcOrigK() {
-  int month, year;
+template<int NP>
+void pdsi::CalcOrigKNP() {
+  int per, year;
   number sums;        //used to calc k
-  float dtemp;
   DKSum = 0;
 
   //FILE * inputd; // File pointer for input file dvalue
@@ -2080,7 +2149,7 @@ void pdsi::CalcOrigK() {
   }
    */
   // Calculate k, which is K', or Palmer's second approximation of K
-  for(int per = 0; per < num_of_periods; per++){
+  for(int per = 0; per < NP; per++){
     if(PSum[per] + LSum[per] == 0)
       sums = 0;//prevent div by 0
     else
@@ -2091,11 +2160,11 @@ void pdsi::CalcOrigK() {
     else
       k[per] = coe_K1_1 * log10((sums + coe_K1_2) / D[per]) + coe_K1_3;
 
-    coefs_mat(per, 4) = k[per];
+    coefs[4][per] = k[per];
 	  DKSum += D[per]*k[per];
   }
 
-  if(Weekly){
+  if(NP != 12){
     //set duration factors to CPC's
     drym = 2.925;
     dryb = 0.075;
@@ -2110,13 +2179,7 @@ void pdsi::CalcOrigK() {
 
 
   // Initializes the book keeping indices used in finding the PDSI
-  Prob = 0.0;
-  X1 = 0.0;
-  X2 = 0.0;
-  X3 = 0.0;
-  X = 0.0;
-  V = 0.0;
-  Q = 0.0;
+  clearX();
 
   // open file point to bigTable.tbl if necessary
   /*
@@ -2142,27 +2205,22 @@ void pdsi::CalcOrigK() {
   else
     table = NULL;
    */
-  // Reads in all previously calclulated d values and calculates Z
-  // then calls CalcX to compute the corresponding PDSI value
-  for(int i = 0; i < vals_mat.nrow(); i++) {
-    year = vals_mat(i, 0);
-    month = vals_mat(i, 1);
-    dtemp = vals_mat(i, 7);
-
-    PeriodList.insert(month);
-    YearList.insert(year);
-    d=dtemp;
-    month--;
-    K_w = coe_K2/DKSum;
-    K_d = K_w;
-    K = K_w * k[month];
+  // Reads in all previously calclulated d values and calculates Z and the
+  // corresponding PDSI value in the same pass
+  K_w = coe_K2/DKSum;
+  K_d = K_w;
+  for(int i = 0; i < nPeriods; i++) {
+    year = i / NP + 1;
+    per = i % NP;
+    d = vals[V_d][i];
+    K = K_w * k[per];
     if(d != MISSING)
       Z = d*K;
     else
       Z = MISSING;
 
-    ZIND.insert(Z);
-    CalcOneX(month, year);
+    vals[V_Z][i] = Z;
+    CalcOneX(per, year);
   }
   // Now that all calculations have been done they can be output to the screen
   /*
@@ -2194,12 +2252,14 @@ void pdsi::CalcOrigK() {
   }
    */
 }//end of CalcOrigK()
+void pdsi::CalcOrigK() {
+  PDSI_NP_DISPATCH(CalcOrigKNP);
+}
 
-void pdsi::CalcZ() {
+template<int NP>
+void pdsi::CalcZNP() {
 
-  int year, per;
-  float dtemp;
-  llist tempZ, tempPer, tempyear;
+  int per;
   DKSum = 0.0; //sum of all D[i] and k[i]; used to calc K
 
   //FILE * inputd; // File pointer for input file dvalue
@@ -2210,22 +2270,15 @@ void pdsi::CalcZ() {
   //  exit(1);
   //}
 
-  for(per = 0; per < num_of_periods; per++)
+  for(per = 0; per < NP; per++)
 	DKSum += D[per] * k[per];
 
-  // Reads in all previously calclulated d values and calculates Z
-  // then calls CalcX to compute the corresponding PDSI value
+  // Reads in all previously calclulated d values and calculates Z, which is
+  // written straight into its column for Calibrate and CalcX
   //while((fscanf(inputd,"%d %d %f", &year, &per, &dtemp))!=EOF) {
-  for(int i = 0; i < vals_mat.nrow(); i++) {
-    year = vals_mat(i, 0);
-    per = vals_mat(i, 1);
-    dtemp = vals_mat(i, 7);
-
-    PeriodList.insert(per);
-    YearList.insert(year);
-    per = (per-1)/period_length;//adjust for use in arrays
-
-    d = dtemp;
+  for(int i = 0; i < nPeriods; i++) {
+    per = i % NP;
+    d = vals[V_d][i];
     K = k[per];
     if(d != MISSING){
       // now that K and d have both been calculated for this per,
@@ -2235,14 +2288,43 @@ void pdsi::CalcZ() {
     else{
       Z = MISSING;
     }
-    ZIND.insert(Z);
+    vals[V_Z][i] = Z;
   }
   //fclose(inputd);
 }//end of CalcZ()
+void pdsi::CalcZ() {
+  PDSI_NP_DISPATCH(CalcZNP);
+}
+//-----------------------------------------------------------------------------
+// CalcPercentiles finds two percentiles (e.g. the 2nd and the 98th) of the
+// values of L with index from <= i < to, skipping MISSING values.  The values
+// are gathered in the pct_work buffer, which is reused between calls.
+//-----------------------------------------------------------------------------
+void pdsi::CalcPercentiles(const series &L, int from, int to,
+                           double lower, double upper,
+                           number &lo, number &hi) {
+  int n = 0;
+  if(from < 0)
+    from = 0;
+  if(to > L.get_size())
+    to = L.get_size();
+  if((int)pct_work.size() < to - from)
+    pct_work.resize(to - from);
+  for(int i = from; i < to; i++) {
+    if(L[i] != MISSING)
+      pct_work[n++] = L[i];
+  }
+  if(n == 0) {
+    lo = MISSING;
+    hi = MISSING;
+    return;
+  }
+  percentiles(&pct_work[0], n, lower, upper, lo, hi);
+}
 void pdsi::Calibrate() {
 
-  llist tempZ, tempweek, tempyear;
   double cal_range;
+  number lower, upper; // 2nd and 98th percentiles of the X values
   int size;
 
 /* SG 6/5/06: Changes made to set dry_ratio and wet_ratio based only
@@ -2250,48 +2332,42 @@ void pdsi::Calibrate() {
 **            If no calibration interval is set, then full history
 **            is used
 */
-  llist tmpXlist; // temporary copy of Xlist, which is unscaled PDSI values
   if ((setCalibrationStartYear == 1) || (setCalibrationEndYear == 1)){
-     copy(tmpXlist, Xlist);
-
-/* SG 6/5/06: Remove the periods from the list until we get to the
-**            start of the calibration interval
+/* SG 6/5/06: Skip the periods before the start of the calibration interval
+**            and, if the series has more periods than the length of the
+**            calibration interval, the periods after its end.  The Xlist
+**            values are unscaled PDSI values and are used in place.
 */
-     for (int i=0; (i < nStartPeriodsToSkip) && (!tmpXlist.is_empty()) ; i++) {
-       tmpXlist.tail_remove(); /* remove periods before the start of the interval */
-     }
-/* SG 6/5/06: We now have a list that begins at the calibration interval.
-**            However, if the list has more periods than the length of the
-**            calibration interval, we must be sure to not go past the
-**            calibration interval length.
-**
-**            So, we now remove the periods from the head of list until we get to the
-**            end of the calibration interval.
+     int from = nStartPeriodsToSkip;
+     int to = Xlist.get_size() - nEndPeriodsToSkip;
+     if (from > Xlist.get_size())
+       from = Xlist.get_size();
+     if (to < from)
+       to = from;
+
+/* SG 6/5/06: Now verify that we have the correct number of periods left in the
+**            calibration interval. If not, print a warning and continue.  The result
+**            will be off, but we not much we can do. So it is better to print the
+**            warning and finish.  This is mostly a debug statement monitoring a
+**            runtime error that should never happen.
 */
-     for (int i=0; (i < nEndPeriodsToSkip) && (!tmpXlist.is_empty()) ; i++) {
-       tmpXlist.head_remove(); /* remove periods before the end of the interval */
-     }
-
-/* SG 6/5/06: Now verify that we have the correct number of periods left in the temp Xlist.
-**            If not, print a warning and continue.  The result will be off, but we not much
-**            we can do. So it is better to print the warning and finish.  This is mostly
-**            a debug statement monitoring a runtime error that should never happen.
-*/
-     size = tmpXlist.get_size();
+     size = to - from;
      if (nCalibrationPeriods != size) {
 	    //printf("Warning: invalid calibration peiords left in Xlist:\n");
 	    //printf("\t Calibration periods left = %d, Xlist size = %d.\n", nCalibrationPeriods, size);
      }
      //calibrate using upper and lower 2% of values within the user-defined calibration interval
      cal_range = 4.0;
-     dry_ratio = (-cal_range / tmpXlist.safe_percentile(0.02));
-     wet_ratio = (cal_range / tmpXlist.safe_percentile(0.98));
+     CalcPercentiles(Xlist, from, to, 0.02, 0.98, lower, upper);
+     dry_ratio = (-cal_range / lower);
+     wet_ratio = (cal_range / upper);
 /* SG 6/5/06: That ends the changes needed for implementing self-calibration intervals. */
   } else {
      //calibrate using upper and lower 2%
      cal_range = 4.0;
-     dry_ratio = (-cal_range / Xlist.safe_percentile(0.02));
-     wet_ratio = (cal_range / Xlist.safe_percentile(0.98));
+     CalcPercentiles(Xlist, 0, Xlist.get_size(), 0.02, 0.98, lower, upper);
+     dry_ratio = (-cal_range / lower);
+     wet_ratio = (cal_range / upper);
   }
 
   K_d = K_d * dry_ratio;
@@ -2306,23 +2382,22 @@ void pdsi::Calibrate() {
   }
 
   //adjust the Z-index values
-  while(!ZIND.is_empty()){
-    Z = ZIND.tail_remove();
+  for(int i = 0; i < nPeriods; i++){
+    Z = vals[V_Z][i];
     if(Z != MISSING){
       if(Z >= 0)
 		Z = Z * wet_ratio;
       else
 		Z = Z * dry_ratio;
     }
-    tempZ.insert(Z);
+    vals[V_Z][i] = Z;
   }
-  copy(ZIND, tempZ);
 
   CalcX();
 }//end of calibrate()
 
-void pdsi::CalcX() {
-  llist tempZ, tempPer, tempYear;
+template<int NP>
+void pdsi::CalcXNP() {
   int year, per;
   //FILE* table;
   /*
@@ -2347,23 +2422,30 @@ void pdsi::CalcX() {
   else
     table = NULL;
   */
-  //empty all X lists
-  while(!Xlist.is_empty())
-    Xlist.head_remove();
-  while(!XL1.is_empty())
-    XL1.head_remove();
-  while(!XL2.is_empty())
-    XL2.head_remove();
-  while(!XL3.is_empty())
-    XL3.head_remove();
-  while(!altX1.is_empty())
-    altX1.head_remove();
-  while(!altX2.is_empty())
-    altX2.head_remove();
-  while(!ProbL.is_empty())
-    ProbL.head_remove();
+  clearX();
+  for(int i = 0; i < nPeriods; i++) {
+    Z = vals[V_Z][i];
+    per = i % NP;
+    year = i / NP + 1;
+
+    CalcOneX(per, year);
+  }
+  //if(table)
+  //  fclose(table);
+}//end of CalcX()
+void pdsi::CalcX() {
+  PDSI_NP_DISPATCH(CalcXNP);
+}
+//-----------------------------------------------------------------------------
+// clearX empties all X lists and initializes the book keeping indices used in
+// finding the PDSI, so that X can be calculated from the start of the record.
+//-----------------------------------------------------------------------------
+void pdsi::clearX() {
+  Xlist.clear();
+  altX1.clear();
+  altX2.clear();
+  altPos.clear();
 
-  // Initializes the book keeping indices used in finding the PDSI
   Prob = 0.0;
   X1 = 0.0;
   X2 = 0.0;
@@ -2371,21 +2453,7 @@ void pdsi::CalcX() {
   X = 0.0;
   V = 0.0;
   Q = 0.0;
-
-  copy(tempZ, ZIND);
-  copy(tempPer, PeriodList);
-  copy(tempYear, YearList);
-
-  while(!tempZ.is_empty()) {
-    Z = tempZ.tail_remove();
-    per = (int)tempPer.tail_remove();
-    year = (int)tempYear.tail_remove();
-
-    CalcOneX(per, year);
-  }
-  //if(table)
-  //  fclose(table);
-}//end of CalcX()
+}
 //-----------------------------------------------------------------------------
 // This function calculates X, X1, X2, and X3
 //
@@ -2448,10 +2516,9 @@ void pdsi::CalcOneX(int period_number, int year) {
 		    newX1=0;
 		    newX2=0;
 		    newX=newX3;
-		    while(!altX1.is_empty())
-		      altX1.head_remove();
-		    while(!altX2.is_empty())
-		      altX2.head_remove();
+		    altX1.clear();
+		    altX2.clear();
+		    altPos.clear();
       }
       else {
 		    newProb=(newV/Q)*100;
@@ -2472,11 +2539,14 @@ void pdsi::CalcOneX(int period_number, int year) {
       Rprintf("%7.2f %7.2f %7.2f\n",newX1, newX2, newX3);
     }
      */
-    vals_mat(n, 8) = Z;
-    vals_mat(n, 9) = newProb;
-    vals_mat(n, 10) = newX1;
-    vals_mat(n, 11) = newX2;
-    vals_mat(n, 12) = newX3;
+    vals[V_Prob][n] = newProb;
+    vals[V_X1][n] = newX1;
+    vals[V_X2][n] = newX2;
+    vals[V_X3][n] = newX3;
+    // The PHDI of a month whose X is later replaced by Backtrack is updated
+    // there; the WPLM does not depend on X.
+    vals[V_PHDI][n] = CalcPHDIValue(newX, newX3);
+    vals[V_WPLM][n] = CalcWPLMValue(newX1, newX2, newX3, newProb);
 
     //update variables for next month:
     V = newV;
@@ -2487,10 +2557,6 @@ void pdsi::CalcOneX(int period_number, int year) {
 
     //add newX to the list of pdsi values
     Xlist.insert(newX);
-    XL1.insert(X1);
-    XL2.insert(X2);
-    XL3.insert(X3);
-    ProbL.insert(Prob);
   }
   else{
     //This month's data is missing, so output MISSING as PDSI.
@@ -2507,17 +2573,14 @@ void pdsi::CalcOneX(int period_number, int year) {
       fprintf(table, "%7.2f %7.2f %7.2f\n",MISSING, MISSING, MISSING);
     }
      */
-    vals_mat(n, 8) = Z;
-    vals_mat(n, 9) = MISSING;
-    vals_mat(n, 10) = MISSING;
-    vals_mat(n, 11) = MISSING;
-    vals_mat(n, 12) = MISSING;
+    vals[V_Prob][n] = MISSING;
+    vals[V_X1][n] = MISSING;
+    vals[V_X2][n] = MISSING;
+    vals[V_X3][n] = MISSING;
+    vals[V_PHDI][n] = MISSING;
+    vals[V_WPLM][n] = MISSING;
 
     Xlist.insert(MISSING);
-    XL1.insert(MISSING);
-    XL2.insert(MISSING);
-    XL3.insert(MISSING);
-	  ProbL.insert(MISSING);
   }
 
 }//end of CalcOneX
@@ -2527,13 +2590,16 @@ void pdsi::CalcOneX(int period_number, int year) {
 // these values for each period in the period.  The potential values are then
 // stored for future use.
 //-----------------------------------------------------------------------------
-void pdsi::SumAll() {
+template<int NP>
+void pdsi::SumAllNP() {
   //FILE * fout;
   //FILE * input_temp, *input_prec;
   //char Temp[150], Precip[150];
   //int actyear;
   int n;
   number DEP=0;
+  wb_state<number> soil;  // soil moisture carried from period to period
+  wb_result<number> wb;   // water balance of the current period
   SD=0;
   SD2=0;
     /* SG 6/5/06: add variable to support a calibration interval */
@@ -2630,23 +2696,31 @@ void pdsi::SumAll() {
     exit(1);
   }
   */
+  number *ys = NULL;  // the values of the sums in the current year
+  if(keep_year_sums) {
+    year_sums.assign((size_t)totalyears * N_SUMS * NP, 0.0);
+    ys = &year_sums[0];
+  }
+
+  soil.Ss = Ss;
+  soil.Su = Su;
   // This loop runs to read in and calculate the values for all years
   for(int year = 1; year <= totalyears; year++) {
     // Get a year's worth of temperature and precipitation data
     // Also, get the current year from the temperature file.
 
-    if(Weekly){
+    if(NP != 12){
       // NOTE: Here T is the vector of PE, instead of tempreature.
-      Rext_get_Rvec(PE_vec, year, T, 52);
-      Rext_get_Rvec(P_vec, year, P, 52);
+      GetInput(PE_in, year, T, 52);
+      GetInput(P_in, year, P, 52);
     }
     else{
-      Rext_get_Rvec(PE_vec, year, T, 12);
-      Rext_get_Rvec(P_vec, year, P, 12);
+      GetInput(PE_in, year, T, 12);
+      GetInput(P_in, year, P, 12);
     }
 
     // This loop runs for each per in the year
-    for(int per = 0; per < num_of_periods; per++) {
+    for(int per = 0; per < NP; per++) {
       if(P[per] >= 0 && T[per] != MISSING){
 		// calculate the Potential Evapotranspiration first
 		// because it's needed in later calculations
@@ -2657,32 +2731,33 @@ void pdsi::SumAll() {
 		      CalcMonPE(per,actyear);
     */
 		    PE = T[per]; // NOTE: Here T is the vector of PE, instead of tempreature.
-		    CalcPR();         // calculate Potential Recharge, Potential Runoff,
-		    CalcPRO();        // and Potential Loss
-		    CalcPL();
-		    CalcActual(per);  // Calculate Evapotranspiration, Recharge, Runoff,
-		                      // and Loss
+		    // calculate Potential Recharge, Potential Runoff, and Potential
+		    // Loss, and Evapotranspiration, Recharge, Runoff, and Loss
+		    wb = wb_step(P[per], PE, AWC, soil);
+		    soil = wb.soil;
 
 		    // Calculates some statistical variables for output
 		    // to the screen in the most verbose mode (verbose > 1)
-		    if(Weekly){
-		      if (per > (17/period_length) && per < (35/period_length)) {
-		    	DEP = DEP + P[per] + L - PE;
-		    	if (per>(30/period_length) && per < (35/period_length)) {
-		    	  SD=SD+DEP;
-		    	  SD2=SD2+DEP*DEP;
-		    	  DEP=0;
-		    	}
+		    if(pdsi_diagnostics) {
+		      if(NP != 12){
+		        if (per > (17/period_length) && per < (35/period_length)) {
+		          DEP = DEP + P[per] + wb.L - PE;
+		          if (per>(30/period_length) && per < (35/period_length)) {
+		            SD=SD+DEP;
+		            SD2=SD2+DEP*DEP;
+		            DEP=0;
+		          }
+		        }
 		      }
-		    }
-		    else{
-		      if (per > 4 && per < 8) {
-		    	DEP = DEP + P[per] + L - PE;
-		    	if (per == 7) {
-		    	  SD=SD+DEP;
-		    	  SD2=SD2+DEP*DEP;
-		    	  DEP=0;
-		    	}
+		      else{
+		        if (per > 4 && per < 8) {
+		          DEP = DEP + P[per] + wb.L - PE;
+		          if (per == 7) {
+		            SD=SD+DEP;
+		            SD2=SD2+DEP*DEP;
+		            DEP=0;
+		          }
+		        }
 		      }
 		    }
 
@@ -2697,26 +2772,35 @@ void pdsi::SumAll() {
       	      nCalibrationPeriodsLeft--;
 
       		    // Update the sums by adding the current water balance values
-      		    ETSum[per] += ET;
-      		    RSum[per] += R;
-      		    ROSum[per] += RO;
-      		    LSum[per] += L;
+      		    ETSum[per] += wb.ET;
+      		    RSum[per] += wb.R;
+      		    ROSum[per] += wb.RO;
+      		    LSum[per] += wb.L;
       		    PSum[per] += P[per];
       		    PESum[per] += PE;
-      		    PRSum[per] += PR;
-      		    PROSum[per] += PRO;
-      		    PLSum[per] += PL;
+      		    PRSum[per] += wb.PR;
+      		    PROSum[per] += wb.PRO;
+      		    PLSum[per] += wb.PL;
       	   }
       	}
+      	if(ys) {
+      	  ys[S_ET * NP + per] = wb.ET;
+      	  ys[S_R * NP + per] = wb.R;
+      	  ys[S_RO * NP + per] = wb.RO;
+      	  ys[S_L * NP + per] = wb.L;
+      	  ys[S_P * NP + per] = P[per];
+      	  ys[S_PE * NP + per] = PE;
+      	  ys[S_PR * NP + per] = wb.PR;
+      	  ys[S_PRO * NP + per] = wb.PRO;
+      	  ys[S_PL * NP + per] = wb.PL;
+      	}
 
-        n = (year-1)*num_of_periods + per;
-      	vals_mat(n, 0) = year;
-      	vals_mat(n, 1) = per * period_length + 1;
-      	vals_mat(n, 2) = P[per];
-      	vals_mat(n, 3) = PE;
-      	vals_mat(n, 4) = PR;
-      	vals_mat(n, 5) = PRO;
-      	vals_mat(n, 6) = PL;
+        n = (year-1)*NP + per;
+      	vals[V_P][n] = P[per];
+      	vals[V_PE][n] = PE;
+      	vals[V_PR][n] = wb.PR;
+      	vals[V_PRO][n] = wb.PRO;
+      	vals[V_PL][n] = wb.PL;
 
 		    //P, PE, PR, PRO, and PL will be used later, so
 		    //these variables need to be stored to an outside file
@@ -2726,23 +2810,28 @@ void pdsi::SumAll() {
 		    //fprintf(fout,"%10.6f\n",P[per]-PE);
       }//matches if(P[per]>= 0 && T[per] != MISSING)
       else {
-        n = (year-1)*num_of_periods + per;
-        vals_mat(n, 0) = year;
-        vals_mat(n, 1) = per * period_length + 1;
-        for(int i = 2; i < 7; i++)
-          vals_mat(n, i) = MISSING;
+        n = (year-1)*NP + per;
+        for(int i = V_P; i <= V_PL; i++)
+          vals[i][n] = MISSING;
 		    //fprintf(fout,"%5d %5d %f ",actyear, (period_length*per)+1,MISSING);
 		    //fprintf(fout,"%10.6f %10.6f %10.6f ", MISSING, MISSING, MISSING);
 		    //fprintf(fout,"%10.6f %10.6f\n",MISSING, MISSING);
       }
     }//end of period loop
+    if(ys)
+      ys += N_SUMS * NP;
   }//end of year loop
+  Ss = soil.Ss;
+  Su = soil.Su;
 
   // We are done with these files for now so close them
   //fclose(fout);
   //fclose(input_temp);
   //fclose(input_prec);
 }
+void pdsi::SumAll() {
+  PDSI_NP_DISPATCH(SumAllNP);
+}
 //-----------------------------------------------------------------------------
 //CalcCMI is a lot like SumAll
 //Equations used come from a Memorandum dated March 29, 1968
@@ -2929,102 +3018,45 @@ void pdsi::CalcPRO() {
 // the rate of (PE-Ss)/AWC*Su.  This means PL = Su*(PE - Ss)/AWC + Ss
 //-----------------------------------------------------------------------------
 void pdsi::CalcPL() {
-  if(Ss >= PE)
-    PL = PE;
-  else {
-    PL = ((PE - Ss) * Su) / (AWC) + Ss;
-    if(PL > PRO)  // If PL>PRO then PL>water in the soil.  This isn't
-      PL = PRO;   // possible so PL is set to the water in the soil
-  }
+  wb_state<number> soil;
+  soil.Ss = Ss;
+  soil.Su = Su;
+  // If PL>PRO then PL>water in the soil.  This isn't possible so wb_PL
+  // limits PL to the water in the soil
+  PL = wb_PL(PE, AWC, soil);
 }
 //-----------------------------------------------------------------------------
 // CalcActual calculates the actual values of evapotranspiration,soil recharge,
 // runoff, and soil moisture loss.  It also updates the soil moisture in both
-// layers for the next period depending on current weather conditions.
+// layers for the next period depending on current weather conditions.  The
+// calculation itself is wb_step, in wb_step.h.
 //-----------------------------------------------------------------------------
 void pdsi::CalcActual(int per) {
-  number R_surface = 0.0;   // recharge of the surface layer
-  number R_under = 0.0;    // recharge of the underlying layer
-  number surface_L = 0.0;   // loss from surface layer
-  number under_L = 0.0;    // loss from underlying layer
-  number new_Su, new_Ss;    // new soil moisture values
-
-
-  if(P[per] >= PE) {
-    // The precipitation exceeded the maximum possible evapotranspiration
-    // (excess moisture)
-    ET = PE;   // Enough moisture for all potential evapotranspiration to occur
-    L = 0.0;   // with no actual loss of soil moisture
-
-    if((P[per] - PE) > (1.0 - Ss)) {
-      // The excess precip will recharge both layers. Note: (1.0 - SS) is the
-      // amount of water needed to saturate the top layer of soil assuming it
-      // can only hold 1 in. of water.
-      R_surface = 1.0 - Ss;
-      new_Ss = 1.0;
-
-      if((P[per] - PE - R_surface) < ((AWC - 1.0) - Su)) {
-		// The entire amount of precip can be absorbed by the soil (no runoff)
-		// and the underlying layer will receive whats left after the top layer
-		// Note: (AWC - 1.0) is the amount able to be stored in lower layer
-		R_under = (P[per] - PE - R_surface);
-		RO = 0.0;
-      }
-      else {
-		// The underlying layer is fully recharged and some runoff will occur
-		R_under = (AWC - 1.0) - Su;
-		RO = P[per] - PE - (R_surface + R_under);
-      }
-      new_Su = Su + R_under;
-      R = R_surface + R_under;//total recharge
-    }
-    else {
-      // There is only enough moisture to recharge some of the top layer.
-      R = P[per] - PE;
-      new_Ss = Ss + R;
-      new_Su = Su;
-      RO = 0.0;
-    }
-  }// End of if(P[per] >= PE)
-  else {
-    // The evapotranspiration is greater than the precipitation received.  This
-    // means some moisture loss will occur from the soil.
-    if(Ss > (PE - P[per])) {
-      // The moisture from the top layer is enough to meet the remaining PE so
-      // only the top layer losses moisture.
-      surface_L = PE - P[per];
-      under_L = 0.0;
-      new_Ss = Ss - surface_L;
-      new_Su = Su;
-    }
-    else {
-      // The top layer is drained, so the underlying layer loses moisture also.
-      surface_L = Ss;
-      under_L = (PE - P[per] - surface_L) * Su / AWC;
-      if(Su < under_L)
-		under_L = Su;
-      new_Ss = 0.0;
-      new_Su = Su - under_L;
-    }
-    R = 0;// No recharge occurs
-    L = under_L + surface_L;// Total loss
-    RO = 0.0;// No extra moisture so no runoff
-    ET = P[per] + L;// Total evapotranspiration
-  }
-  Ss = new_Ss;//update soil moisture values
-  Su = new_Su;
+  wb_state<number> soil;
+  wb_result<number> wb;
+
+  soil.Ss = Ss;
+  soil.Su = Su;
+  wb = wb_step(P[per], PE, AWC, soil);
+  ET = wb.ET;
+  R = wb.R;
+  L = wb.L;
+  RO = wb.RO;
+  Ss = wb.soil.Ss;//update soil moisture values
+  Su = wb.soil.Su;
 }//end of CalcActual(int per)
 //-----------------------------------------------------------------------------
 // This function calculates Alpha, Beta, Gamma, and Delta, the normalizing
 // climate coefficients in the water balance equation.
 // If the user desires, the results are output to the screen and a file.
 //-----------------------------------------------------------------------------
-void pdsi::CalcWBCoef() {
+template<int NP>
+void pdsi::CalcWBCoefNP() {
 
   //FILE *wb;
 
   // The coefficients are calculated by per
-  for (int per=0; per < num_of_periods; per++) {
+  for (int per=0; per < NP; per++) {
 
     //calculate alpha:
     if(PESum[per] != 0.0)
@@ -3057,11 +3089,11 @@ void pdsi::CalcWBCoef() {
       Delta[per] = 0.0;
   }
 
-  for(int i = 0; i < num_of_periods; i++){
-    coefs_mat(i, 0) = Alpha[i];
-    coefs_mat(i, 1) = Beta[i];
-    coefs_mat(i, 2) = Gamma[i];
-    coefs_mat(i, 3) = Delta[i];
+  for(int i = 0; i < NP; i++){
+    coefs[0][i] = Alpha[i];
+    coefs[1][i] = Beta[i];
+    coefs[2][i] = Gamma[i];
+    coefs[3][i] = Delta[i];
   }
   /*
   if(extra==1 || extra == 9){
@@ -3079,6 +3111,9 @@ void pdsi::CalcWBCoef() {
   }
    */
 }//end CalcWBCoef()
+void pdsi::CalcWBCoef() {
+  PDSI_NP_DISPATCH(CalcWBCoefNP);
+}
 //-----------------------------------------------------------------------------
 // The Write() function will write the PDSI to the default directory.
 // If it is a weekly PDSI, it will go to the "weekly/" directory
@@ -3189,7 +3224,7 @@ void pdsi::WriteCMI(char* dir) {
   int cyear=startyear;
   int prev, cur, saved_per, change_per;
   number c;
-  llist tempCMI, tempweek;
+  series tempCMI, tempweek;
   FILE *cmi0, *cmi1;
   char filename[80];
 
@@ -3272,7 +3307,7 @@ void pdsi::FinalWrite(char* dir) {
   int cyear=startyear;
   int prev, cur, saved_per, change_per;
   number x, x1, x2, x3, p, wp, ph, z;
-  llist tempX, tempX1, tempX2, tempX3, tempZ, tempP, tempweek;
+  series tempX, tempX1, tempX2, tempX3, tempZ, tempP, tempweek;
   FILE *pdsi0, *pdsi1, *phdi0, *phdi1, *zind0, *zind1, *wplm0, *wplm1;
   char filename[80];
 
@@ -3561,22 +3596,38 @@ int pdsi::ReprintFile(char* src, char *des){
 //-----------------------------------------------------------------------------
 void pdsi::Backtrack(number X1, number X2) {
   number num1,num2;
-  node * ptr=NULL;
   num1=X1;
-  while (!altX1.is_empty() && !altX2.is_empty()) {
+  // The pending X1/X2 values belong to the most recent non-MISSING months,
+  // whose positions in Xlist were recorded by StoreAltX, so each month is
+  // replaced directly, from the newest back to the oldest one.
+  for (int i = altX1.get_size() - 1; i >= 0; i--) {
     if (num1>0) {
-      num1=altX1.head_remove();
-      num2=altX2.head_remove();
+      num1=altX1[i];
+      num2=altX2[i];
     }
     else {
-      num1=altX2.head_remove();
-      num2=altX1.head_remove();
+      num1=altX2[i];
+      num2=altX1[i];
     }
     if (-tolerance<=num1 && num1<=tolerance) num1=num2;
-    ptr=Xlist.set_node(ptr,num1);
+    Xlist[altPos[i]]=num1;
+    vals[V_PHDI][altPos[i]]=CalcPHDIValue(num1, vals[V_X3][altPos[i]]);
   }
+  altX1.clear();
+  altX2.clear();
+  altPos.clear();
 }//end of backtrack()
 //-----------------------------------------------------------------------------
+// StoreAltX keeps the X1 and X2 values of the current period for possible
+// backtracking later, together with the position its X value will take in
+// Xlist once CalcOneX has inserted it.
+//-----------------------------------------------------------------------------
+void pdsi::StoreAltX(number newX1, number newX2) {
+  altX1.insert(newX1);
+  altX2.insert(newX2);
+  altPos.push_back(Xlist.get_size());
+}
+//-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 void pdsi::ChooseX(number& newX, number& newX1, number& newX2, number& newX3, int bug)
 {
@@ -3633,16 +3684,14 @@ void pdsi::ChooseX(number& newX, number& newX1, number& newX2, number& newX3, in
 		newX = newX1;
       }
       else{
-		altX1.insert(newX1);
-		altX2.insert(newX2);
+		StoreAltX(newX1, newX2);
 		newX = newX3;
       }
     }
 
     else{
-      //store X1 and X2 in their linked lists for possible use later
-      altX1.insert(newX1);
-      altX2.insert(newX2);
+      //store X1 and X2 in their series for possible use later
+      StoreAltX(newX1, newX2);
       newX = newX3;
     }
   }
@@ -3661,91 +3710,32 @@ void pdsi::CalcDurFact(number &slope, number &intercept, int sign){
   //it appears that there needs to be a different weight given to
   //negative and positive Z values, so the variable 'sign' will
   //determine whether the driest or wettest periods are looked at.
+  //
+  //the accumulated Z index of each length is found by CalcZSums(),
+  //which must be called first.
 
   int num_list = 10;
   number sum[10];
-  int length[10];
   int i;
 
-  if(Weekly){
-    if(period_length==1){
-      length[0]=13;
-      length[1]=26;
-      length[2]=39;
-      length[3]=52;
-      length[4]=78;
-      length[5]=104;
-      length[6]=130;
-      length[7]=156;
-      length[8]=182;
-      length[9]=208;
-    }
-    else if(period_length==2){
-      length[0]=6;
-      length[1]=13;
-      length[2]=19;
-      length[3]=26;
-      length[4]=39;
-      length[5]=52;
-      length[6]=65;
-      length[7]=78;
-      length[8]=91;
-      length[9]=104;
-    }
-    else if(period_length==4){
-      length[0]=3;
-      length[1]=6;
-      length[2]=10;
-      length[3]=13;
-      length[4]=20;
-      length[5]=26;
-      length[6]=33;
-      length[7]=39;
-      length[8]=46;
-      length[9]=52;
-    }
-    else if(period_length==13){
-      length[0]=2;
-      length[1]=3;
-      length[2]=4;
-      length[3]=5;
-      length[4]=6;
-      length[5]=8;
-      length[6]=10;
-      length[7]=12;
-      length[8]=14;
-      length[9]=16;
-    }
-  }
-  else{
-    length[0]=3;
-    length[1]=6;
-    length[2]=9;
-    length[3]=12;
-    length[4]=18;
-    length[5]=24;
-    length[6]=30;
-    length[7]=36;
-    length[8]=42;
-    length[9]=48;
-  }
-
-
   for(i = 0; i < num_list; i++){
-    sum[i] = get_Z_sum(length[i],sign);
+    if(sign == 1)
+      sum[i] = wet_Z_sum[i];
+    else
+      sum[i] = dry_Z_sum[i];
     //printf("sum[%d] = %f\n",i,sum[i]);
   }
   //if(verbose > 1){
     //printf("Points used in linear regression for Duration Factors:\n");
     //for(i=0;i<num_list;i++)
-      //printf("%7d  ",length[i]);
+      //printf("%7d  ",dur_length[i]);
     //printf("\n");
     //for(i=0;i<num_list;i++)
       //printf("%7.2f  ",sum[i]);
     //printf("\n");
   //}
 
-  LeastSquares(length, sum, num_list, sign, slope, intercept);
+  LeastSquares(dur_length, sum, num_list, sign, slope, intercept);
 
   //printf("the line is: y = %f * x + %f\n",slope,intercept);
 
@@ -3756,105 +3746,188 @@ void pdsi::CalcDurFact(number &slope, number &intercept, int sign){
   intercept = intercept / (sign*4);
 }//end of CalcDurFact()
 
-number pdsi::get_Z_sum(int length, int sign) {
-  number sum, max_sum, z;
-  llist tempZ, list_to_sum, list_of_sums;
-
+//-----------------------------------------------------------------------------
+// CalcZSums finds, for each of the 10 spell lengths used by CalcDurFact, the
+// accumulated Z index of the wettest and of the driest spell of that length
+// within the calibration interval.
+//
+// The Z values from the start of the calibration interval are gathered,
+// skipping MISSING ones, together with their running (prefix) sum, so the
+// sum over any window of non-MISSING values is a difference of two prefix
+// sums and all lengths and both signs share one pass over Z.  As before,
+// the first window of a length takes as many periods as needed to collect
+// that many non-MISSING values, even past the end of the calibration
+// interval; the following windows slide up to the end of the interval.
+//
+// The wet sum is the highest "reasonable" sum, i.e. the highest one that is
+// less than 25% above the 98th percentile of all sums of that length.  The
+// dry sum is the lowest sum.
+//-----------------------------------------------------------------------------
+void pdsi::CalcZSums() {
+  int num_list = 10;
+  int i, j, L;
+  int n_all;   // non-MISSING Z values from the start of the interval
+  int n_cal;   // non-MISSING Z values within the interval
+  int n;       // non-MISSING Z values a window of length L may cover
+  int n_sums;
+  int end;
+  number z, sum, max_sum, min_sum;
+  number lower, upper;
   number highest_reasonable;
-  number percentile;
   number reasonable_tol = 1.25;
-/* SG 6/5/06: Add variable to implement user-defined calibration interval */
-  int nCalibrationPeriodsLeft;
-
-  copy(tempZ,ZIND);
-  sum = 0;
+  number *prefix, *sums;
 
-/* SG 6/5/06: Remove the periods from the list until we get to the
-**            start of the calibration interval
-*/
-  for (int i=0; (i < nStartPeriodsToSkip) && (!tempZ.is_empty()) ; i++) {
-    tempZ.tail_remove(); /* remove periods before the start of the interval */
-  }
-/* SG 6/5/06: We now have a list that begins at the calibration interval.
-**            However, if the list has more periods than the length of the
-**            calibration interval, we must be sure to not go past the
-**            calibration interval length
-*/
-   nCalibrationPeriodsLeft = nCalibrationPeriods; /* init periods left */
-  //first fill the list to be summed
-  for(int i = 0; i < length; i++){
-    if(tempZ.is_empty()){
-      //printf("Error: tempZ is empty.\n");
-      i = length;
+  if(Weekly){
+    if(period_length==1){
+      dur_length[0]=13;
+      dur_length[1]=26;
+      dur_length[2]=39;
+      dur_length[3]=52;
+      dur_length[4]=78;
+      dur_length[5]=104;
+      dur_length[6]=130;
+      dur_length[7]=156;
+      dur_length[8]=182;
+      dur_length[9]=208;
     }
-    else {
-      z = tempZ.tail_remove();
-      nCalibrationPeriodsLeft--; /* reduce by one period for each remove */
-   				 /* assumes that nCalibrationPeriods is >= length, reasonable
-                                 ** This is a reasonable assumption and does not hurt if
-                                 ** anything if false--just calibrate over a slightly longer
-                                 ** interval, which is already way too short in that case */
-      if(z != MISSING){
-		sum += z;
-		list_to_sum.insert(z);
-      }
-      else{
-		i--;
-      }
+    else if(period_length==2){
+      dur_length[0]=6;
+      dur_length[1]=13;
+      dur_length[2]=19;
+      dur_length[3]=26;
+      dur_length[4]=39;
+      dur_length[5]=52;
+      dur_length[6]=65;
+      dur_length[7]=78;
+      dur_length[8]=91;
+      dur_length[9]=104;
+    }
+    else if(period_length==4){
+      dur_length[0]=3;
+      dur_length[1]=6;
+      dur_length[2]=10;
+      dur_length[3]=13;
+      dur_length[4]=20;
+      dur_length[5]=26;
+      dur_length[6]=33;
+      dur_length[7]=39;
+      dur_length[8]=46;
+      dur_length[9]=52;
+    }
+    else if(period_length==13){
+      dur_length[0]=2;
+      dur_length[1]=3;
+      dur_length[2]=4;
+      dur_length[3]=5;
+      dur_length[4]=6;
+      dur_length[5]=8;
+      dur_length[6]=10;
+      dur_length[7]=12;
+      dur_length[8]=14;
+      dur_length[9]=16;
     }
-    //printf("i = %d  z= %f  sum = %f\n",i,z,sum);
   }
-
-
-  //now for each remaining Z value,
-  //recalculate the sum based on last value in the
-  //list to sum and the next Z value
-  max_sum = sum;
-  list_of_sums.insert(sum);
-  while(!tempZ.is_empty() && nCalibrationPeriodsLeft > 0){
-    z = tempZ.tail_remove();
-    nCalibrationPeriodsLeft--; /* reduce by one period for each remove */
+  else{
+    dur_length[0]=3;
+    dur_length[1]=6;
+    dur_length[2]=9;
+    dur_length[3]=12;
+    dur_length[4]=18;
+    dur_length[5]=24;
+    dur_length[6]=30;
+    dur_length[7]=36;
+    dur_length[8]=42;
+    dur_length[9]=48;
+  }
+
+/* SG 6/5/06: Skip the periods until we get to the
+**            start of the calibration interval
+*/
+  end = nStartPeriodsToSkip + nCalibrationPeriods;
+  if(end > nPeriods)
+    end = nPeriods;
+
+  // prefix[k] is the sum of the first k non-MISSING Z values; sums holds
+  // the window sums of one length.
+  if((int)zsum_work.size() < 2 * (nPeriods + 1))
+    zsum_work.resize(2 * (nPeriods + 1));
+  prefix = &zsum_work[0];
+  sums = prefix + nPeriods + 1;
+
+  n_all = 0;
+  n_cal = 0;
+  prefix[0] = 0;
+  for(i = nStartPeriodsToSkip; i < nPeriods; i++){
+    z = vals[V_Z][i];
     if(z != MISSING){
-      sum -= list_to_sum.tail_remove();
-      sum += z;
-      list_to_sum.insert(z);
-      list_of_sums.insert(sum);
+      prefix[n_all + 1] = prefix[n_all] + z;
+      n_all++;
+      if(i < end)
+        n_cal++;
     }
-    if(sign * sum > sign * max_sum)
-      max_sum = sum;
   }
 
-  //highest reasonable is the highest (or lowest)
-  //value that is not due to some freak anomaly in the
-  //data.
-  //"freak anomaly" is defined as a value that is either
-  //   1) 25% higher than the 98th percentile
-  //   2) 25% lower than the 2nd percentile
-  //
-  highest_reasonable = 0;
-  if(sign == 1)
-    percentile = list_of_sums.safe_percentile(.98);
-  if(sign == -1)
-    percentile = list_of_sums.safe_percentile(.02);
-
-  while(!list_of_sums.is_empty()){
-    sum = list_of_sums.tail_remove();
-    if(sign * sum > 0 ){
-      if( (sum / percentile) < reasonable_tol ) {
-		if(sign * sum > sign * highest_reasonable )
-		  highest_reasonable = sum;
+  for(i = 0; i < num_list; i++){
+    L = dur_length[i];
+    if(n_cal >= L)
+      n = n_cal;
+    else
+      n = (L < n_all) ? L : n_all;
+
+    if(n < L){
+      //not enough values for a whole window: the only sum is
+      //the sum of all of them
+      sums[0] = prefix[n];
+      n_sums = 1;
+    }
+    else{
+      n_sums = n - L + 1;
+      for(j = 0; j < n_sums; j++)
+        sums[j] = prefix[j + L] - prefix[j];
+    }
+
+    max_sum = sums[0];
+    min_sum = sums[0];
+    for(j = 1; j < n_sums; j++){
+      if(sums[j] > max_sum)
+        max_sum = sums[j];
+      if(sums[j] < min_sum)
+        min_sum = sums[j];
+    }
+
+    //highest reasonable is the highest (or lowest)
+    //value that is not due to some freak anomaly in the
+    //data.
+    //"freak anomaly" is defined as a value that is either
+    //   1) 25% higher than the 98th percentile
+    //   2) 25% lower than the 2nd percentile
+    //
+    //the percentiles skip MISSING sums, which cannot be
+    //reasonable wet sums anyway.
+    j = 0;
+    for(int k = 0; k < n_sums; k++){
+      if(sums[k] != MISSING)
+        sums[j++] = sums[k];
+    }
+    n_sums = j;
+    if(n_sums > 0)
+      percentiles(sums, n_sums, .02, .98, lower, upper);
+    else
+      upper = MISSING;
+
+    highest_reasonable = 0;
+    for(j = 0; j < n_sums; j++){
+      sum = sums[j];
+      if(sum > 0 && (sum / upper) < reasonable_tol){
+        if(sum > highest_reasonable)
+          highest_reasonable = sum;
       }
     }
-  }
 
-  if(sign == -1)
-    return max_sum;
-  else if(sign == 1)
-    //return max_sum;
-    return highest_reasonable;
-  else
-    return MISSING;
-}//end of get_Z_sum()
+    wet_Z_sum[i] = highest_reasonable;
+    dry_Z_sum[i] = min_sum;
+  }
+}//end of CalcZSums()
 
 void pdsi::LeastSquares(int *x, number *y, int n, int sign, number &slope, number &intercept) {
   number sumX, sumX2, sumY, sumY2, sumXY;
@@ -3937,53 +4010,22 @@ void pdsi::LeastSquares(int *x, number *y, int n, int sign, number &slope, numbe
 }//end of LeastSquares()
 
 number pdsi::getPDSI(int period, int year) {
-  return getValue(Xlist, period, year);
+  return getValue(Xlist.data(), Xlist.get_size(), period, year);
 }
 number pdsi::getZIND(int period, int year) {
-  return getValue(ZIND, period, year);
+  return getValue(vals[V_Z], nPeriods, period, year);
 }
 number pdsi::getWPLM(int period, int year) {
-
-  number x1,x2,x3,p,wp;
-
-  x1 = getValue(XL1, period, year);
-  x2 = getValue(XL2, period, year);
-  x3 = getValue(XL3, period, year);
-  p = getValue(ProbL, period, year);
-  if(x1 == MISSING || x2 == MISSING || x3 == MISSING || p == MISSING)
-	wp = MISSING;
-  else{
-	p = p / 100;
-	if (x3==0) {
-	  // There is not an established wet or dry spell so PHDI = PDSI (ph=x)
-	  // and the WPLM value is the maximum absolute value of X1 or X2
-	  wp=x1;
-	  if (-x2>(x1+tolerance))
-		wp=x2;
-	}
-	else if (p>(0+tolerance/100) && p<(1-tolerance/100)) {
-	  // There is an established spell but there is a possibility it has or is
-	  // ending.  The WPLM is then a weighted average between X3 and X1 or X2
-	  if (x3 < 0)
-		// X3 is negative so WPLM is weighted average of X3 and X1
-		wp=(1-p)*x3 + p*x1;
-	  else
-		// X3 is positive so WPLM is weighted average of X3 and X2
-		wp=(1-p)*x3 + p*x2;
-	}
-	else
-	  // There is an established spell without possibility of end meaning the
-	  // WPLM is simply X3
-	  wp=x3;
-  }
-  return wp;
+  return getValue(vals[V_WPLM], Xlist.get_size(), period, year);
 }
 
 number pdsi::getPHDI(int period, int year) {
-  number x, x3;
-
-  x = getValue(Xlist, period, year);
-  x3 = getValue(XL3, period, year);
+  return getValue(vals[V_PHDI], Xlist.get_size(), period, year);
+}
+//-----------------------------------------------------------------------------
+// The PHDI is X3 during an established spell and the PDSI otherwise.
+//-----------------------------------------------------------------------------
+number pdsi::CalcPHDIValue(number x, number x3) {
   if(x == MISSING || x3 == MISSING)
 	return MISSING;
   if(x3==0)
@@ -3991,41 +4033,119 @@ number pdsi::getPHDI(int period, int year) {
   else
 	return x3;
 }
+//-----------------------------------------------------------------------------
+// The WPLM weights X3 and X1 or X2 by p, the probability (in percent) that
+// the current spell has ended.
+//-----------------------------------------------------------------------------
+number pdsi::CalcWPLMValue(number x1, number x2, number x3, number p) {
+  number wp;
 
-number pdsi::getValue(llist &List, int period, int year) {
-  llist tempPer, tempYear, tempList;
-  number per, yr, val;
-  bool loop_exit = false;
+  if(x1 == MISSING || x2 == MISSING || x3 == MISSING || p == MISSING)
+	return MISSING;
 
-  copy(tempList, List);
-  copy(tempPer, PeriodList);
-  copy(tempYear, YearList);
+  p = p / 100;
+  if (x3==0) {
+	// There is not an established wet or dry spell so PHDI = PDSI (ph=x)
+	// and the WPLM value is the maximum absolute value of X1 or X2
+	wp=x1;
+	if (-x2>(x1+tolerance))
+	  wp=x2;
+  }
+  else if (p>(0+tolerance/100) && p<(1-tolerance/100)) {
+	// There is an established spell but there is a possibility it has or is
+	// ending.  The WPLM is then a weighted average between X3 and X1 or X2
+	if (x3 < 0)
+	  // X3 is negative so WPLM is weighted average of X3 and X1
+	  wp=(1-p)*x3 + p*x1;
+	else
+	  // X3 is positive so WPLM is weighted average of X3 and X2
+	  wp=(1-p)*x3 + p*x2;
+  }
+  else
+	// There is an established spell without possibility of end meaning the
+	// WPLM is simply X3
+	wp=x3;
+  return wp;
+}
+//-----------------------------------------------------------------------------
+// The per-period series hold consecutive periods starting at period 1 of
+// year 1, so the index of any period follows from its distance to the first
+// one.
+//-----------------------------------------------------------------------------
+int pdsi::getLinear(int period, int year) {
+  return year * num_of_periods + (period - 1) / period_length;
+}
+int pdsi::getOffset(int period, int year) {
+  if(year < 1 || period < 1 || period > num_of_periods * period_length ||
+     (period - 1) % period_length != 0)
+	return -1;
+  return getLinear(period, year) - getLinear(1, 1);
+}
 
-  while(! loop_exit) {
-	if(tempList.is_empty())
-	  loop_exit = true;
-	if(tempPer.is_empty())
-	  loop_exit = true;
-	if(YearList.is_empty())
-	  loop_exit = true;
+number pdsi::getValue(const number *List, int size, int period, int year) {
+  int n = getOffset(period, year);
+  if(n < 0 || n >= size)
+	return MISSING;
+  return List[n];
+}
 
-	val = tempList.head_remove();
-	per = tempPer.head_remove();
-	yr = tempYear.head_remove();
+series_view pdsi::getView(const number *List, int size,
+			  int start_per, int start_yr,
+			  int end_per, int end_yr) {
+  series_view view;
+  int first, last;
+
+  first = getLinear(start_per, start_yr) - getLinear(1, 1);
+  last = getLinear(end_per, end_yr) - getLinear(1, 1) + 1;
+  if(first < 0)
+	first = 0;
+  if(last > size)
+	last = size;
+
+  view.data = List;
+  view.size = 0;
+  if(last > first) {
+	view.data = List + first;
+	view.size = last - first;
+  }
+  return view;
+}
 
-	if(yr == year && per == period)
-	  return val;
-  }
-  return MISSING;
+series_view pdsi::getPDSIView(int start_per, int start_yr,
+			      int end_per, int end_yr) {
+  return getView(Xlist.data(), Xlist.get_size(),
+		 start_per, start_yr, end_per, end_yr);
+}
+series_view pdsi::getZINDView(int start_per, int start_yr,
+			      int end_per, int end_yr) {
+  return getView(vals[V_Z], nPeriods, start_per, start_yr, end_per, end_yr);
+}
+series_view pdsi::getPHDIView(int start_per, int start_yr,
+			      int end_per, int end_yr) {
+  return getView(vals[V_PHDI], Xlist.get_size(),
+		 start_per, start_yr, end_per, end_yr);
+}
+series_view pdsi::getWPLMView(int start_per, int start_yr,
+			      int end_per, int end_yr) {
+  return getView(vals[V_WPLM], Xlist.get_size(),
+		 start_per, start_yr, end_per, end_yr);
 }
 
 number* pdsi::getYearArray(int &size) {
-  size = YearList.get_size();
-  return YearList.returnArray();
+  number *Array;
+  size = nPeriods;
+  Array = new number[size];
+  for(int i = 0; i < size; i++)
+    Array[i] = i / num_of_periods + 1;
+  return Array;
 }
 number* pdsi::getPerArray(int &size) {
-  size = PeriodList.get_size();
-  return PeriodList.returnArray();
+  number *Array;
+  size = nPeriods;
+  Array = new number[size];
+  for(int i = 0; i < size; i++)
+    Array[i] = (i % num_of_periods) * period_length + 1;
+  return Array;
 }
 number* pdsi::getCMIArray(int &size) {
   size = CMIList.get_size();
@@ -4033,7 +4153,8 @@ number* pdsi::getCMIArray(int &size) {
 }
 number* pdsi::getCMIArray(int start_per, int start_yr,
 			  int end_per, int end_yr, int &size){
-  return getSubArray(CMIList, start_per, start_yr, end_per, end_yr, size);
+  return getSubArray(CMIList.data(), CMIList.get_size(),
+		     start_per, start_yr, end_per, end_yr, size);
 }
 number* pdsi::getPDSIArray(int &size) {
   size = Xlist.get_size();
@@ -4041,289 +4162,76 @@ number* pdsi::getPDSIArray(int &size) {
 }
 number* pdsi::getPDSIArray(int start_per, int start_yr,
 			   int end_per, int end_yr, int &size) {
-  return getSubArray(Xlist, start_per, start_yr, end_per, end_yr, size);
+  return getSubArray(Xlist.data(), Xlist.get_size(),
+		     start_per, start_yr, end_per, end_yr, size);
 }
 number* pdsi::getZINDArray(int &size){
-  size = ZIND.get_size();
-  return ZIND.returnArray();
+  size = nPeriods;
+  return copyArray(vals[V_Z], size);
 }
 number* pdsi::getZINDArray(int start_per, int start_yr,
 			   int end_per, int end_yr, int &size) {
-  return getSubArray(ZIND, start_per, start_yr, end_per, end_yr, size);
+  return getSubArray(vals[V_Z], nPeriods,
+		     start_per, start_yr, end_per, end_yr, size);
 }
 number* pdsi::getPHDIArray(int &size) {
-  number *x, *x3;
-  x = Xlist.returnArray();
-  x3 = XL3.returnArray();
   size = Xlist.get_size();
-  number *A = new number[size];
-  if(A == NULL){
-	size = 0;
-	return A;
-  }
-  for(int i = 0; i < size; i++){
-	if(x[i] != MISSING){
-	  if(x3[i]==0)
-		A[i] = x[i];
-	  else
-		A[i] = x3[i];
-	}
-	else
-	  A[i] = MISSING;
-  }
-  delete [] x;
-  delete [] x3;
-  return A;
+  return copyArray(vals[V_PHDI], size);
 }
 number* pdsi::getPHDIArray(int start_per, int start_yr,
 			   int end_per, int end_yr, int &size) {
-  number *x, *x3;
-  int tempsize;
-  x = getSubArray(Xlist, start_per, start_yr, end_per, end_yr, size);
-  x3 = getSubArray(XL3, start_per, start_yr, end_per, end_yr, tempsize);
-  number *A = new number[size];
-  if(A == NULL){
-	size = 0;
-	return A;
-  }
-  for(int i = 0; i < size; i++){
-    if(x[i] != MISSING){
-      if(x3[i]==0)
-        A[i] = x[i];
-      else
-        A[i] = x3[i];
-    }
-    else
-      A[i] = MISSING;
-  }
-  delete [] x;
-  delete [] x3;
-  return A;
+  return getSubArray(vals[V_PHDI], Xlist.get_size(),
+		     start_per, start_yr, end_per, end_yr, size);
 }
 number* pdsi::getWPLMArray(int &size) {
-  number *A;
-  number *x1Array,*x2Array,*x3Array,*pArray;
-  number x1, x2, x3, p, wp;
-
-  x1Array = XL1.returnArray();
-  x2Array = XL2.returnArray();
-  x3Array = XL3.returnArray();
-  pArray = ProbL.returnArray();
-
-  size = XL1.get_size();
-
-  A = new number[size];
-  if(A == NULL){
-	size = 0;
-	return A;
-  }
-
-  for(int i = 0; i < size; i++){
-	x1 = x1Array[i];
-	x2 = x2Array[i];
-	x3 = x3Array[i];
-	p = pArray[i];
-
-	if(x1 == MISSING || x2 == MISSING || x3 == MISSING || p == MISSING)
-	  wp = MISSING;
-	else{
-	  p = p / 100;
-	  if (x3==0) {
-		// There is not an established wet or dry spell so PHDI = PDSI (ph=x)
-		// and the WPLM value is the maximum absolute value of X1 or X2
-		wp=x1;
-		if (-x2>(x1+tolerance))
-		  wp=x2;
-	  }
-	  else if (p>(0+tolerance/100) && p<(1-tolerance/100)) {
-		// There is an established spell but there is a possibility it has or is
-		// ending.  The WPLM is then a weighted average between X3 and X1 or X2
-		if (x3 < 0)
-		  // X3 is negative so WPLM is weighted average of X3 and X1
-		  wp=(1-p)*x3 + p*x1;
-		else
-		  // X3 is positive so WPLM is weighted average of X3 and X2
-		  wp=(1-p)*x3 + p*x2;
-	  }
-	  else
-		// There is an established spell without possibility of end meaning the
-		// WPLM is simply X3
-		wp=x3;
-	}
-	A[i] = wp;
-  }
-  delete [] x1Array;
-  delete [] x2Array;
-  delete [] x3Array;
-  delete [] pArray;
-  return A;
+  size = Xlist.get_size();
+  return copyArray(vals[V_WPLM], size);
 }
 number* pdsi::getWPLMArray(int start_per, int start_yr,
 			   int end_per, int end_yr, int &size) {
-  number *A;
-  number *x1Array,*x2Array,*x3Array,*pArray;
-  number x1, x2, x3, p, wp;
-  int tempsize;
-
-  x1Array = getSubArray(XL1, start_per, start_yr, end_per, end_yr, size);
-  x2Array = getSubArray(XL2, start_per, start_yr, end_per, end_yr, tempsize);
-  x3Array = getSubArray(XL3, start_per, start_yr, end_per, end_yr, tempsize);
-  pArray = getSubArray(ProbL, start_per, start_yr, end_per, end_yr, tempsize);
-
-  A = new number[size];
-  if(A == NULL){
-    size = 0;
-    return A;
-  }
-
-  for(int i = 0; i < size; i++){
-    x1 = x1Array[i];
-    x2 = x2Array[i];
-    x3 = x3Array[i];
-    p = pArray[i];
-
-	if(x1 == MISSING || x2 == MISSING || x3 == MISSING || p == MISSING)
-      wp = MISSING;
-	else{
-	  p = p / 100;
-	  if (x3==0) {
-		// There is not an established wet or dry spell so PHDI = PDSI (ph=x)
-		// and the WPLM value is the maximum absolute value of X1 or X2
-		wp=x1;
-		if (-x2>(x1+tolerance))
-		  wp=x2;
-	  }
-	  else if (p>(0+tolerance/100) && p<(1-tolerance/100)) {
-		// There is an established spell but there is a possibility it has or is
-		// ending.  The WPLM is then a weighted average between X3 and X1 or X2
-		if (x3 < 0)
-		  // X3 is negative so WPLM is weighted average of X3 and X1
-		  wp=(1-p)*x3 + p*x1;
-		else
-		  // X3 is positive so WPLM is weighted average of X3 and X2
-		  wp=(1-p)*x3 + p*x2;
-	  }
-	  else
-		// There is an established spell without possibility of end meaning the
-		// WPLM is simply X3
-		wp=x3;
-	}
-    A[i] = wp;
-  }
-  delete [] x1Array;
-  delete [] x2Array;
-  delete [] x3Array;
-  delete [] pArray;
-  return A;
+  return getSubArray(vals[V_WPLM], Xlist.get_size(),
+		     start_per, start_yr, end_per, end_yr, size);
 }
-number* pdsi::getSubArray(llist &List, int start_per, int start_yr,
+//-----------------------------------------------------------------------------
+// copyArray returns a new array with the first size values of List.
+// The caller must delete [] the array.
+//-----------------------------------------------------------------------------
+number* pdsi::copyArray(const number *List, int size) {
+  number *Array = new number[size];
+  for(int i = 0; i < size; i++)
+    Array[i] = List[i];
+  return Array;
+}
+//-----------------------------------------------------------------------------
+// getSubArray returns a new array with the values from (start_per, start_yr)
+// to (end_per, end_yr).  Periods outside the calculated record are MISSING.
+// The caller must delete [] the array.
+//-----------------------------------------------------------------------------
+number* pdsi::getSubArray(const number *List, int list_size,
+			  int start_per, int start_yr,
 			  int end_per, int end_yr, int &size) {
+  number *Array;
+  int first;
+  int i, n;
 
-  llist temp;
-  number *Array, *year, *period;
-  int i,j;
-  int cur_per, cur_yr;
-  int per_len=0;
-  int num_missing;
-
-  Array = List.returnArray();
-  year = YearList.returnArray();
-  period = PeriodList.returnArray();
-
-  for(j = 0; j < PeriodList.get_size(); j++){
-    if(period[j] > per_len)
-      per_len = (int)period[j];
-  }
-  //printf("per_len is: %d\n",per_len);
-  //printf("size of list is: %d\n",PeriodList.get_size() );
-
-  if( (start_yr > year[0]) ||
-      ( (start_yr == year[0]) && (start_per > period[0]) ) ) {
-    i = 0;
-    while( ( ( year[i] < start_yr ) ||
-		   ( year[i] == start_yr && period[i] < start_per ) ) &&
-		 ( i < List.get_size() ) ) {
-	i++;
-    }
-    while( ( ( year[i] < end_yr ) ||
-		   ( year[i] == end_yr && period[i] <= end_per ) ) &&
-		 ( i < List.get_size() ) ) {
-	temp.insert(Array[i]);
-	i++;
-    }
-    if(i == List.get_size()){
-      cur_yr = (int)year[i-1];
-      cur_per = (int)period[i-1];
-      if((cur_per%per_len) == 0){
-        cur_per = 1;
-        cur_yr++;
-      }
-      else
-        cur_per++;
-      while( (cur_yr < end_yr) ||
-             ( (cur_yr == end_yr) && (cur_per <= end_per)) ) {
-        temp.insert(MISSING);
-        if((cur_per%per_len) == 0){
-          cur_per = 1;
-          cur_yr++;
-        }
-        else
-          cur_per++;
-      }
-    }
-
+  size = getLinear(end_per, end_yr) - getLinear(start_per, start_yr) + 1;
+  if(size < 0)
+    size = 0;
+  Array = new number[size];
+  if(Array == NULL){
+    size = 0;
+    return Array;
   }
 
-  else {
-    if(start_yr == year[0])
-      num_missing = (int)period[0] - start_per;
-    else{
-      if(period[0] <= start_per)
-        num_missing = ((int)year[0] - start_yr - 1)*per_len + ((int)period[0] - start_per + per_len);
-      else
-        num_missing = ((int)year[0] - start_yr)*per_len + ((int)period[0] - start_per);
-    }
-    //printf("num_missing=%d\n",num_missing);
-    for(j = 0; j < num_missing; j++)
-      temp.insert(MISSING);
-
-    i = 0;
-    while( ( ( year[i] < end_yr ) ||
-                   ( year[i] == end_yr && period[i] <= end_per ) ) &&
-                 ( i < List.get_size() ) ) {
-        temp.insert(Array[i]);
- 	//printf("i=%d  cur_date: %d/%d  end_date: %d/%d\n",i,(int)period[i],(int)year[i],end_per,end_yr);
-        i++;
-    }
-    if(i == List.get_size()){
-      cur_yr = (int)year[i-1];
-      cur_per = (int)period[i-1];
-      if((cur_per%per_len) == 0){
-        cur_per = 1;
-        cur_yr++;
-      }
-      else
-        cur_per++;
-      while( (cur_yr < end_yr) ||
-             ( (cur_yr == end_yr) && (cur_per <= end_per)) ) {
-        temp.insert(MISSING);
-        //printf("here i=%d  cur_date: %d/%d  end_date: %d/%d\n",i,cur_per,cur_yr,end_per,end_yr);
-        if((cur_per%per_len) == 0){
-          cur_per = 1;
-          cur_yr++;
-        }
-        else
-          cur_per++;
-      }
-    }
+  first = getLinear(start_per, start_yr) - getLinear(1, 1);
+  for(i = 0; i < size; i++){
+    n = first + i;
+    if(n >= 0 && n < list_size)
+      Array[i] = List[n];
+    else
+      Array[i] = MISSING;
   }
-  delete [] Array;
-  delete [] year;
-  delete [] period;
-
-  size = temp.get_size();
-  return temp.returnArray();
-
+  return Array;
 }
 
 inline int pdsi::is_int(char *string,int length) {
@@ -4340,335 +4248,143 @@ inline int pdsi::is_flt(char *string,int length) {
 }
 
 //-----------------------------------------------------------------------------
-//**********   START OF FUNCTION DEFINITIONS FOR CLASS:  llist        *********
+//**********   START OF FUNCTION DEFINITIONS FOR CLASS:  series       *********
 //-----------------------------------------------------------------------------
-// The constructor for this function creates the sentinel for the
-// double-linked list and points head to it.  The sentinel is a node that
-// contains pointer to the beginning and to the end of the list.  Here both
-// of these pointers point back to the sentinel itself.
+// The constructor creates an empty series.  No storage is allocated until
+// the first value is inserted or reserve() is called.
 //-----------------------------------------------------------------------------
-llist::llist() {
-  head = new node;       // Creates the sentinel with head pointing to it
-  head->next = head;     // Sets the sentinels front pointer to itself
-  head->previous = head; // Sets the sentinels rear pointer to itself
-  size = 0;
+series::series() {
+  first = 0;
+  last = 0;
 }
 //-----------------------------------------------------------------------------
-// The destructor for this function deallocates all of the memory
-// for the entire list.  In order to do this it must move through
-// the list and delete each of these nodes.  Then it deletes the
-// sentinel.
+// reserve makes sure n values can be inserted without any allocation.  The
+// values already in the series are kept.
 //-----------------------------------------------------------------------------
-llist::~llist() {
-  node *mover;                // The temporary pointer to perform the work
-
-  mover = head->next;         // mover starts at the node after the sentinel
-  while (mover != head) {     // This loop occurs until mover has come complete
-                              // circle and is pointing at the sentinel
-    mover = mover->next;      // mover becomes the next node
-    delete mover->previous;   // The previous node is then deleted
-  }
-  delete mover;               // Finally the sentinel is deleted
+void series::reserve(int n) {
+  if(first > 0) {
+    // move the values to the front of the buffer first so the whole
+    // capacity can be used
+    for(int i = first; i < last; i++)
+      buf[i - first] = buf[i];
+    last -= first;
+    first = 0;
+  }
+  if((int)buf.size() < n)
+    buf.resize(n);
 }
 //-----------------------------------------------------------------------------
-// The insert function places a new node with the integer value x
-// between the sentinel and the first element in the list.  This
-// effectively makes this new node the first element in the list.
-//-----------------------------------------------------------------------------
-void llist::insert(number x) {
-  node *inserter;      // A new pointer to the node to be added
-  inserter = new node; // This creates the node and points inserter to it
-  inserter->key = x;   // The value in inserter is set to x
-
-  inserter->next = head->next;        // The next field of the new node is
-                                      // set to the node after the sentinel
-  inserter->previous = head;          // The previous field is set to the
-                                      // sentinel
-  inserter->next->previous = inserter;// The previous field of the node after
-                                      // inserter is set to inserter
-  inserter->previous->next = inserter;// The sentinels next field is set to
-                                      // inserter
-  size++;                             // update size
+// clear empties the series without releasing its storage.
+//-----------------------------------------------------------------------------
+void series::clear() {
+  first = 0;
+  last = 0;
 }
-int llist::get_size() {
-  return size;
+//-----------------------------------------------------------------------------
+// grow is called by insert when the head has reached the end of the buffer.
+// It reuses the space freed by tail_remove if there is any, otherwise the
+// buffer is doubled.
+//-----------------------------------------------------------------------------
+void series::grow() {
+  int size = last - first;
+  if(first > 0 && size < (int)buf.size() / 2)
+    reserve((int)buf.size());
+  else
+    reserve(size < 8 ? 16 : 2 * (int)buf.size());
+}
+//-----------------------------------------------------------------------------
+// The insert function places the value x on the head of the series.
+//-----------------------------------------------------------------------------
+void series::insert(number x) {
+  if(last == (int)buf.size())
+    grow();
+  buf[last] = x;
+  last++;
+}
+int series::get_size() const {
+  return last - first;
 }
 
-number* llist::returnArray() {
-
-  node* cur;
-  int i;
+number* series::returnArray() {
+  int size = last - first;
   number* A = new number[size];
   if(A != NULL){
-	cur = head->previous;
-	i = 0;
-	while(cur != head){
-	  A[i] = cur->key;
-	  i++;
-	  cur=cur->previous;
-	}
+    for(int i = 0; i < size; i++)
+      A[i] = buf[first + i];
   }
   return A;
-
 }
 //-----------------------------------------------------------------------------
-// The head_remove function removes the first node on the list and
-// returns the value stored in that node
+// The head_remove function removes the newest value of the series and
+// returns it
 //-----------------------------------------------------------------------------
-number llist::head_remove() {
+number series::head_remove() {
   if(is_empty()) {
     return MISSING;
   }
-
-  node *remover;
-  number x;
-
-  remover=head->next;
-  x=remover->key;
-  // First the previous field of the next node is set to head
-  remover->next->previous = head;
-  // Then the next field of head is set to the node after remover
-  head->next = remover->next;
-  size--;          //update size;
-  delete remover;  // Finally the node can be deleted and function ends
-  return x;  // The key is returned
+  last--;
+  return buf[last];
 }
 //-----------------------------------------------------------------------------
-// The tail_remove function removes the last nod on the list and
-// returns the value stored in that node
+// The tail_remove function removes the oldest value of the series and
+// returns it
 //-----------------------------------------------------------------------------
-number llist::tail_remove() {
+number series::tail_remove() {
   if(is_empty()) {
     return MISSING;
   }
-  node *remover;
-  number x;
-
-  remover=head->previous;
-  x=remover->key;
-  //First the next field of the previous node is set to head
-  remover->previous->next = head;
-  //Then the previous field of head is set to the node before remover
-  head->previous = remover->previous;
-  size--;            //update size
-  delete remover;    // Finally the node can be deleted
-  return x; // The key is returned
+  first++;
+  return buf[first - 1];
 }
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
-node *llist::set_node(node *set, number x) {
-  int error=1;
-  node *comparer;
-
-  if (set==NULL)
-    set=head->next;
-  comparer = head->next;
-  while(comparer != head) {
-    if(comparer == set) {
-      error=0;
-      break;
-    }
-    comparer = comparer->next;
-  }
-
-  if(error==1) {
-    return NULL;
-  }
-  else {
-    if(set->key != MISSING){
-      set->key = x;
-      return set->next;
-    }
-    else {
-      //if the node is MISSING, then don't replace
-      //that key.  instead, replace the first non-MISSING
-      //node you come to.
-      return set_node(set->next,x);
-    }
-  }
-}
-//-----------------------------------------------------------------------------
-//-----------------------------------------------------------------------------
-int llist::is_empty() {
-  if(head->next==head)
+int series::is_empty() const {
+  if(last == first)
     return 1;
   else
     return 0;
 }
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
-void copy(llist &L1,const llist &L2) {
-  while (!L1.is_empty())
-    L1.tail_remove();
-
-  node *comparer;
-  comparer = L2.head->previous;
-  while (comparer!=L2.head) {
-    L1.insert(comparer->key);
-    comparer = comparer->previous;
-  }
+void copy(series &L1,const series &L2) {
+  int size = L2.last - L2.first;
+  L1.clear();
+  L1.reserve(size);
+  for(int i = 0; i < size; i++)
+    L1.buf[i] = L2.buf[L2.first + i];
+  L1.last = size;
 }
-number llist::sumlist(){
+number series::sumlist(){
 
   number sum = 0;
 
-  node* cur;
-  cur = head->previous;
-  while(cur != head){
-    sum += cur->key;
-    cur = cur->previous;
-  }
+  for(int i = first; i < last; i++)
+    sum += buf[i];
 
   return sum;
 }
-
-void llist::sumlist(number &prev_sum, int sign){
-
-  //printf("in sumlist(number &prev_sum, int sign)\n");
-  number sum = 0;
-
-  node* cur;
-  cur = head->previous;
-  while(cur != head){
-    sum += cur->key;
-    cur = cur->previous;
-  }
-
-  if(sign*sum > sign * prev_sum)
-    prev_sum = sum;
-
-
-  return;
-}
-number llist::maxlist(){
+number series::maxlist(){
   number max = 0;
 
-  node * cur;
-  cur = head->previous;
-  while(cur != head){
-    if(cur->key > max)
-      max = cur->key;
-    cur = cur->previous;
+  for(int i = first; i < last; i++){
+    if(buf[i] > max)
+      max = buf[i];
   }
 
   return max;
 }
-number llist::minlist(){
+number series::minlist(){
   number min = 0;
 
-  node * cur;
-  cur = head->previous;
-  while(cur != head){
-    if(cur->key < min)
-      min = cur->key;
-    cur = cur->previous;
+  for(int i = first; i < last; i++){
+    if(buf[i] < min)
+      min = buf[i];
   }
 
   return min;
 }
-number llist::kthLargest(int k) {
-  if(k < 1 || k > size)
-    return MISSING;
-  else if(k == 1)
-    return minlist();
-  else if(k == size)
-    return maxlist();
-
-  else{
-    //place the list in an array for
-    //easier selection
-    number *A;
-    int i;
-    number return_value;
-    node* cur = head->previous;
-    A = new number[size];
-    if(A != NULL){
-      for(i = 0; i < size; i++){
-		if(cur->key != MISSING)
-		  A[i] = cur->key;
-		cur = cur->previous;
-      }
-      select(A,0,size-1,k);
-
-      return_value = A[k-1];
-      delete []A;
-    }
-    else {
-      long_select(k);
-    }
-    return return_value;
-  }
-}
-number llist::quartile(int q) {
-  //q0 is the minimum
-  if(q == 0)
-    return minlist();
-  //q4 is the maximum
-  else if(q == 4)
-    return maxlist();
-
-  //q2 is the median
-  else if(q == 2) {
-    //if the size of the list is even, there is no exact median
-    //so take the average of the two closest numbers
-    if(size%2 == 0){
-      double t1 = kthLargest(size/2);
-      double t2 = kthLargest(size/2 + 1);
-      return (t1+t2)/2;
-    }
-    else
-      return kthLargest(1 + (size-1)/2);
-  }
-
-  //q1 is the first quartile, q3 is the third quartile
-  else if(q == 1 || q == 3){
-    //if (size+1) is not divisble by 4, there is no exact quartiles
-    //so take the weighted average of the two closest numbers
-    int k;
-    if((k = ((size-1)%4)) != 0){
-      int bottom = (int)std::floor(q*(size-1)/4);
-      double t1 = (4-k) * kthLargest(bottom+1);
-      double t2 = (k) * kthLargest(bottom+2);
-      return (t1+t2)/4;
-    }
-    else
-      return kthLargest(1 + q*(size-1)/4);
-  }
-  else
-    return MISSING;
-}
-//safe percentile is a safer version of percentile that
-//takes MISSING values into account
-number llist::safe_percentile(double percentage) {
-  llist temp;
-  node* cur = head->next;
-  while(cur != head){
-    if(cur->key != MISSING)
-      temp.insert(cur->key);
-    cur = cur->next;
-  }
-  return temp.percentile(percentage);
-}
-number llist::percentile(double percentage) {
-  int k;
-
-  //the argument may not be in correct demical
-  //representation of a percentage, that is,
-  //it may be a whole number like 25 instead of .25
-  if(percentage > 1)
-    percentage = percentage / 100;
-  k = (int)(percentage * size);
-  return kthLargest(k);
-}
-number llist::long_select(int k) {
-  //haven't gotten around to doing this function yet.
-  //it's pretty low priority for me.
-  //printf("Low Memory.\n");
-  return MISSING;
-
-}
 //-----------------------------------------------------------------------------
-//**********   CLOSE OF FUNCTION DEFINITIONS FOR CLASS:  llist        *********
+//**********   CLOSE OF FUNCTION DEFINITIONS FOR CLASS:  series       *********
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 //The numEntries() function returns the number of entries in the file
@@ -4683,42 +4399,155 @@ int numEntries(FILE *in) {
   return i;
 }
 //-----------------------------------------------------------------------------
-//These three functions, partition(), select(), and exch() are used to select
-//the kth largest number in an array.
-//Partition partitions a subarray around the a key such that all entries above
-//  the key are greater than the key, and all entries below are less than it.
-//  The rightmost element in the subarray is used as the key.
-//Select arranges the array in such a way that the kth largest item in the
-//  array is in the kth spot, that is at index # (k-1).
-//Exch simply switches the values of the two arguments.
-//To possibly speed up the process, these three functions could be combined,
-//  meaning there would be far fewer function calls.
-//-----------------------------------------------------------------------------
-int partition(number a[], int left, int right) {
-  number val = a[right];
-  int i = left - 1;
-  for(int j = left; j < right; j++){
-	if(a[j] <= val){
-	  i++;
-	  exch(a[i],a[j]);
-	}
+//percentiles() finds two percentiles of the n numbers in a[] (for example the
+//2nd and the 98th) with one selection pass: the upper one is selected first,
+//after which the lower one only has to be looked for among the values below
+//it.  As in the original list code the kth value is taken with
+//k = (int)(percentage * n), the smallest (k == 1) and largest (k == n)
+//values are taken relative to 0, and MISSING is returned when k is out of
+//range.  a[] is reordered; nothing is allocated.
+//
+//introselect() arranges a[l..r] so that a[k] holds the value it would have
+//if a[l..r] were sorted, with no larger value before it and no smaller value
+//after it.  It is a quickselect with a median of three pivot and a three-way
+//partition, so runs of equal values are settled at once.  When a[l..r] has
+//not halved within steps median of three steps, the pivots are taken as the
+//median of medians until it has, which bounds the work to O(n) in the worst
+//case.  With steps == 0 every pivot is the median of medians.
+//-----------------------------------------------------------------------------
+void percentiles(number a[], int n, double lower, double upper,
+                 number &lo, number &hi) {
+  int klo, khi;
+
+  //the arguments may not be in correct demical
+  //representation of a percentage, that is,
+  //they may be whole numbers like 25 instead of .25
+  if(lower > 1)
+    lower = lower / 100;
+  if(upper > 1)
+    upper = upper / 100;
+  klo = (int)(lower * n);
+  khi = (int)(upper * n);
+
+  if(khi > 1 && khi < n) {
+    introselect(a, 0, n-1, khi-1, SELECT_STEPS);
+    hi = a[khi-1];
   }
-  exch(a[i+1],a[right]);
-  return i+1;
-}
+  else
+    hi = select_extreme(a, n, khi);
 
-void select(number a[], int l, int r, int k) {
-  int i;
-  if (r <= l)
-	return;
-
-  i = partition(a, l, r);
-  if (i > k-1)
-	select(a, l, i-1, k);
-  else if (i < k-1)
-	select(a, i+1, r, k);
+  //a[] is only partitioned around khi when the upper value was selected
+  if(klo > 1 && klo < n) {
+    if(klo < khi && khi < n)
+      introselect(a, 0, khi-2, klo-1, SELECT_STEPS);
+    else if(klo != khi)
+      introselect(a, 0, n-1, klo-1, SELECT_STEPS);
+    lo = a[klo-1];
+  }
   else
-	return;
+    lo = select_extreme(a, n, klo);
+}
+//-----------------------------------------------------------------------------
+//select_extreme() handles the k values percentiles() does not select for.
+//-----------------------------------------------------------------------------
+number select_extreme(number a[], int n, int k) {
+  number x = 0;
+  if(k < 1 || k > n)
+    return MISSING;
+  else if(k == 1) {
+    for(int i = 0; i < n; i++)
+      if(a[i] < x)
+        x = a[i];
+  }
+  else {
+    for(int i = 0; i < n; i++)
+      if(a[i] > x)
+        x = a[i];
+  }
+  return x;
+}
+void introselect(number a[], int l, int r, int k, int steps) {
+  int lt, gt, i;
+  int left = steps;       //median of three steps left before a[l..r] halves
+  int size = r - l + 1;   //the size of a[l..r] when left was last reset
+  number pivot;
+
+  while(r > l) {
+    if(r - l < 16) {
+      insertion_sort(a, l, r);
+      return;
+    }
+    if(2 * (r - l + 1) <= size) {
+      size = r - l + 1;
+      left = steps;
+    }
+    if(left > 0) {
+      pivot = median3(a[l], a[l + (r-l)/2], a[r]);
+      left--;
+    }
+    else
+      pivot = median_of_medians(a, l, r);
+
+    //three-way partition: a[l..lt-1] < pivot, a[lt..gt] == pivot,
+    //a[gt+1..r] > pivot
+    lt = l;
+    gt = r;
+    i = l;
+    while(i <= gt) {
+      if(a[i] < pivot)
+        exch(a[lt++], a[i++]);
+      else if(a[i] > pivot)
+        exch(a[i], a[gt--]);
+      else
+        i++;
+    }
+
+    if(k < lt)
+      r = lt - 1;
+    else if(k > gt)
+      l = gt + 1;
+    else
+      return;
+  }
+}
+number median_of_medians(number a[], int l, int r) {
+  int ng = 0;
+  int e;
+
+  if(r - l < 5) {
+    insertion_sort(a, l, r);
+    return a[l + (r-l)/2];
+  }
+  //sort each group of five and gather the medians at the front
+  for(int i = l; i <= r; i += 5) {
+    e = (i + 4 < r) ? i + 4 : r;
+    insertion_sort(a, i, e);
+    exch(a[l + ng], a[i + (e-i)/2]);
+    ng++;
+  }
+  introselect(a, l, l + ng - 1, l + (ng-1)/2, 0);
+  return a[l + (ng-1)/2];
+}
+number median3(number x, number y, number z) {
+  if(x < y) {
+    if(y < z) return y;
+    return (x < z) ? z : x;
+  }
+  if(x < z) return x;
+  return (y < z) ? z : y;
+}
+void insertion_sort(number a[], int l, int r) {
+  number key;
+  int j;
+  for(int i = l + 1; i <= r; i++) {
+    key = a[i];
+    j = i - 1;
+    while(j >= l && a[j] > key) {
+      a[j+1] = a[j];
+      j--;
+    }
+    a[j+1] = key;
+  }
 }
 void exch(number &x, number &y) {
   number temp;
@@ -1,10 +1,25 @@
 #ifndef PDSI_H
 #define PDSI_H
 
+#include <algorithm>
+#include <vector>
+#ifdef SCPDSI_NO_R
+// The core alone, for the drivers that run it outside R (inst/mpi): the
+// Rext_ functions taking or returning R objects are left out.
+#include <cstdio>
+#define Rprintf printf
+#else
 #include <Rcpp.h>
 #include <R.h>
+#endif
+
+#include "wb_step.h"
 
+struct wb_isa;
+
+#ifndef SCPDSI_NO_R
 using namespace Rcpp;
+#endif
 
 // This defines the type number as a double.  This is used to easily change
 // the PDSI's variable types.
@@ -13,72 +28,95 @@ typedef int flag;
 #define min(a,b) ((a) < (b) ? (a) : (b));
 #define MISSING -999.00
 
-//-----------------------------------------------------------------------------
-//**********   START OF STRUCTURE DEFINITION FOR STRUCT:  node        *********
-//-----------------------------------------------------------------------------
-// The node struct is used specifically in the linked list class and is not
-// relevant to the actual PDSI.
-//-----------------------------------------------------------------------------
-struct node {            // A structure for a node
-public:
-  number key;            // Where the data is stored
-  struct node *next;     // Where the next node is
-  struct node *previous; // Where the previous node is
+// The status returned by the core of the calculation, which does not call
+// into R so that it can run off the main thread.  The Rext_ functions turn
+// these into R errors and warnings.
+enum pdsi_status {
+  PDSI_OK = 0,
+  PDSI_ERR_YEARS,        // start year not earlier than end year
+  PDSI_ERR_CALIB_YEARS,  // calibrating start year not earlier than end year
+  PDSI_ERR_SHORT,        // fewer years of input than years to calculate
+  PDSI_ERR_PERIODS,      // unsupported number of periods per year
+  PDSI_ERR_MEMORY        // the workspace could not be allocated
 };
 
-//-----------------------------------------------------------------------------
-//**********   CLOSE OF STRUCTURE DEFINITION FOR STRUCT:  node        *********
-//-----------------------------------------------------------------------------
+// Flags set in pdsi::warnings when the calibrating years were moved into
+// the years calculated.
+enum pdsi_warning {
+  PDSI_WARN_CALIB_START = 1,
+  PDSI_WARN_CALIB_END = 2
+};
+
+// The statistics that the original program only printed in its most verbose
+// mode (DSSqr, DSAct, SPhat, DEPSum, SD and SD2) are not needed for the
+// index.  They are accumulated only in a diagnostic build, made by adding
+// -DPDSI_DIAGNOSTICS to PKG_CPPFLAGS; otherwise the code computing them is
+// folded away by the compiler.
+#ifdef PDSI_DIAGNOSTICS
+const bool pdsi_diagnostics = true;
+#else
+const bool pdsi_diagnostics = false;
+#endif
 
 //-----------------------------------------------------------------------------
-//**********   START OF CLASS DEFINITIONS FOR THE CLASS:  llist       *********
+//**********   START OF CLASS DEFINITIONS FOR THE CLASS:  series      *********
 //-----------------------------------------------------------------------------
-// The llist class is a dynamic storage class.  It is used in the PDSI to
-// eliminate problems with filling static arrays.
+// The series class stores one value per period in a single contiguous
+// buffer.  It replaces the linked list of the original program: new values
+// are placed on the head of the series and can be consumed from either end
+// by moving an index, so nothing is allocated per value once the buffer has
+// been reserved for the length of the record.
+// Element 0 is the tail (the oldest value) and element get_size()-1 is the
+// head (the most recently inserted value).
 //-----------------------------------------------------------------------------
-class llist {            // A linked list class
+class series {           // A contiguous series class
 private:
-  node *head;            // A pointer to the head of the linked-list
-  int size;
-  number kthLargest(int k);  //returns the kth largest number in the list
-  number long_select(int k); //returns the kth largest number in the list
-  //without using an array or sorting.  Used when
-  //there is not enough memory to place the entire
-  //list in a new array.
-  number percentile(double percentage); //returns the specified percentile
+  std::vector<number> buf; // The storage of the series
+  int first;             // Index of the tail of the series in buf
+  int last;              // Index one past the head of the series in buf
+  void grow();           // Makes room for one more value on the head
 
 public:
-  llist();               // The constructor
-  ~llist();              // The destructor
+  series();              // The constructor
+  // reserve makes room for n values so that inserting them will not
+  // allocate.  clear empties the series but keeps the storage.
+  void reserve(int n);
+  void clear();
   // The insert function takes an argument of type number and places it on
-  // the head of the linked list.
+  // the head of the series.
   void insert(number x);
   // The remove functions remove from either the head (head_remove) or the
-  // tail (tail_remove) of the linked list.
-  number head_remove();  // remove the first node and returns its key
-  number tail_remove();  // remove the last node and returns its key
-  // These are other useful functions used in dealing with linked lists
-  int is_empty();// Returns 1 if the llist is empty 0 otherwise
-  int get_size();
-  number sumlist();  // Sums the items in list
-  void sumlist(number &prev_sum, int sign);//sums items in list into prev_sum
+  // tail (tail_remove) of the series.
+  number head_remove();  // remove the newest value and returns it
+  number tail_remove();  // remove the oldest value and returns it
+  // These are other useful functions used in dealing with the series
+  int is_empty() const;  // Returns 1 if the series is empty 0 otherwise
+  int get_size() const;
+  // Direct access to the i-th value counted from the tail.
+  number &operator[](int i) { return buf[first + i]; }
+  number operator[](int i) const { return buf[first + i]; }
+  const number* data() const { return buf.empty() ? NULL : &buf[0] + first; }
+  number sumlist();  // Sums the items in the series
   number maxlist();
   number minlist();
-  number quartile(int q);        //returns the qth quartile
-  number safe_percentile(double percentage); //safe version
 
   number* returnArray();
 
-  // The set_node function sets the key of the node pointed to by set.  It
-  // checks the linked list to make sure set is in the node to prevent
-  // runtime errors from occuring.  It was written specifically for the PDSI
-  // program and its backtracking function.
-  node *set_node(node *set=NULL, number x=0);
-  friend void copy(llist &L1,const llist &L2); // Copies L2 to L1
+  friend void copy(series &L1,const series &L2); // Copies L2 to L1
 };
 //-----------------------------------------------------------------------------
-//**********   CLOSE OF CLASS DEFINITIONS FOR THE CLASS:  llist       *********
+//**********   CLOSE OF CLASS DEFINITIONS FOR THE CLASS:  series      *********
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// A series_view refers to size consecutive values stored in a series.  It
+// does not own them and is only valid until the series is next changed.
 //-----------------------------------------------------------------------------
+struct series_view {
+  const number *data;    // The first value of the view
+  int size;              // The number of values in the view
+};
+
 
 //-----------------------------------------------------------------------------
 //**********   START OF CLASS DEFINITIONS FOR THE CLASS:  pdsi        *********
@@ -145,14 +183,46 @@ public:
   number* getYearArray(int &size);
   number* getPerArray(int &size);
 
+  // These functions return the values from (start_per, start_yr) to
+  // (end_per, end_yr) as a view into the stored series, without copying.
+  // Periods outside the calculated record are left out of the view.
+  series_view getPDSIView(int start_per, int start_yr,
+                          int end_per, int end_yr);
+  series_view getZINDView(int start_per, int start_yr,
+                          int end_per, int end_yr);
+  series_view getPHDIView(int start_per, int start_yr,
+                          int end_per, int end_yr);
+  series_view getWPLMView(int start_per, int start_yr,
+                          int end_per, int end_yr);
+
   /* Added functions and variables for run in R */
 
   /* Added fields for run in R */
-  NumericVector P_vec;
-  NumericVector PE_vec;
-
-  NumericMatrix vals_mat;
-  NumericMatrix coefs_mat;
+  // The input series of the current station, input_len values each.  They
+  // are not copied, so they must outlive the calculation.
+  const number *P_in;
+  const number *PE_in;
+  int input_len;
+
+  // The per-period results are stored one variable per column, each column
+  // a contiguous vector in period order, so row n is period
+  // n % num_of_periods + 1 of year n / num_of_periods + 1.  vals points at
+  // the data of vals_col, or at the columns of the caller given to
+  // BindVals, nValsPeriods values each.
+  enum { V_P, V_PE, V_PR, V_PRO, V_PL, V_d, V_Z, V_Prob, V_X1, V_X2, V_X3,
+         V_X, V_PHDI, V_WPLM, N_VALS };
+  std::vector<number> vals_col[N_VALS];
+  number *vals[N_VALS];
+  int nValsPeriods;
+  // BindVals makes the results go straight into the caller's columns
+  // cols[V_P] to cols[V_WPLM] of nperiods values each, e.g. the vectors
+  // returned to R, instead of being copied out of vals_col.  They stay in
+  // use until a Load or Reserve needs longer columns; Copy gives the copy
+  // columns of its own.
+  void BindVals(number *const *cols, int nperiods);
+  // coefs[j][per] is alpha, beta, gamma, delta (j = 0 to 3) and K1 (j = 4)
+  // of each period.
+  number coefs[5][52];
 
   //NumericVector d_vec;
   //NumericVector Z_vec;
@@ -170,20 +240,121 @@ public:
   number coe_m;
   number coe_b;
 
+  // Defaults sets the options and coefficients used by the R package.
+  // A pdsi can be reused as a workspace for many series.  Reserve sizes the
+  // result columns and the per-period series for up to max_years years, and
+  // Load loads a new series into them without reallocating, keeping the
+  // coefficients set by Rext_set_parcoefs and Rext_set_calib.  Only the
+  // first nPeriods values of each column belong to the current series.
+  // PDSI_mon then calculates the monthly index.  None of them calls into R,
+  // so separate pdsi objects can be used on separate threads; Load and
+  // PDSI_mon return a pdsi_status, and Load sets the pdsi_warning flags of
+  // the series in warnings.
+  int nPeriods;
+  int nReservedPeriods;
+  int warnings;
+  void Defaults();
+  void Reserve(int max_years);
+  // Copy makes this workspace a copy of src, so that a second index can be
+  // calculated from the state src has reached, e.g. after PDSI_mon_coefs.
+  // The input series are not copied.
+  void Copy(const pdsi &src);
+  int Load(const number *P, const number *PE, int len,
+           number AWC,
+           int s_yr, int e_yr,
+           int calib_s_yr, int calib_e_yr);
+  int PDSI_mon(bool SC);
+  // PDSI_mon is PDSI_mon_sums (PDSI_mon_setup and SumAll) and
+  // PDSI_mon_finish.  They can be called one by one to do the water balance
+  // of several series at once with SumAllLanes instead of SumAll.
+  int PDSI_mon_sums();
+  void PDSI_mon_setup();
+  int PDSI_mon_finish(bool SC);
+  // PDSI_mon_finish is PDSI_mon_coefs, which calculates the water balance
+  // coefficients and d, and PDSI_mon_index, which calculates K, Z and the
+  // indices from them.  Only PDSI_mon_index depends on the coefficients of
+  // Rext_set_parcoefs, so it can be called again after changing them.
+  void PDSI_mon_coefs();
+  int PDSI_mon_index(bool SC);
+  static void SumAllLanes(pdsi *const *ws, int nyears, const wb_isa &isa,
+                          std::vector<number> &work);
+
+  // When keep_year_sums is set, SumAll also keeps what each period with
+  // data adds to the sums when it is in the calibration interval, so that
+  // the sums of other years can be made up without running the water
+  // balance again: year_sums[(y * N_SUMS + s) * num_of_periods + per] is
+  // the value of sum s (ETSum to PLSum, in the order of S_ET to S_PL) for
+  // period per of year y + 1, 0 for a period without data.  SumAllLanes
+  // does not keep them.
+  enum { S_ET, S_R, S_RO, S_L, S_P, S_PE, S_PR, S_PRO, S_PL, N_SUMS };
+  bool keep_year_sums;
+  std::vector<number> year_sums;
+  // LoadYears makes this workspace the record of the years years[0] to
+  // years[nyears - 1] of src (0 for its first year), one after the other,
+  // calibrated over all of them.  The water balance columns are copied and
+  // the sums made up from the year_sums of src, so PDSI_mon_coefs and
+  // PDSI_mon_index follow without SumAll.  The coefficients of this
+  // workspace are kept.  Returns a pdsi_status.
+  int LoadYears(const pdsi &src, const int *years, int nyears);
+  // Recalibrate moves the calibration interval of the series, after SumAll
+  // with keep_year_sums set, making up its sums from year_sums as SumAll
+  // would have, so PDSI_mon_finish follows without SumAll and gives the
+  // results of Load with those calibrating years.  Returns a pdsi_status
+  // and sets the pdsi_warning flags in warnings, as Load does.
+  int Recalibrate(int calib_s_yr, int calib_e_yr);
+  // CumYearSums accumulates year_sums over the years into year_cum, so
+  // that year_cum[(y * N_SUMS + s) * num_of_periods + per] is the sum of
+  // sum s for period per over the first y years.  ClimCoefs then takes the
+  // sums of any calibration interval as the difference of two of its rows
+  // instead of adding up its years, and calculates the water balance
+  // coefficients, d and K1 (coefs) from them without the index.  It also
+  // counts the periods without data before each year into year_missing, so
+  // that as many periods are made up after the end of the interval as in
+  // Recalibrate.  The differences round differently from the sums of
+  // SumAll.  Returns a pdsi_status and sets the pdsi_warning flags.
+  std::vector<number> year_cum;
+  std::vector<int> year_missing;
+  void CumYearSums();
+  int ClimCoefs(int calib_s_yr, int calib_e_yr);
+
+#ifndef SCPDSI_NO_R
+  // The same for a series held by R, raising an R error on failure.
   void Rext_init(NumericVector& P, NumericVector& PE,
   	             number AWC,
                  int s_yr, int e_yr,
                  int calib_s_yr, int calib_e_yr);
+  void Rext_reset(NumericVector& P, NumericVector& PE,
+                  number AWC,
+                  int s_yr, int e_yr,
+                  int calib_s_yr, int calib_e_yr);
+#endif
   void Rext_set_parcoefs(number K1_1, number K1_2, number K1_3, number K2,
   	number p, number q);
 
-  void Rext_PDSI_mon(bool SC);
+  // The self-calibration is repeated at most calib_max_iter times, or until
+  // both the wet and dry ratios are within calib_tol of 1 (when calib_tol is
+  // positive).  calib_iter is the number of passes actually made.
+  int calib_max_iter;
+  number calib_tol;
+  int calib_iter;
+  void Rext_set_calib(int max_iter, number tol);
 
-  void Rext_get_Rvec(NumericVector R_vec, int year, number* A, int freq);
+#ifndef SCPDSI_NO_R
+  void Rext_PDSI_mon(bool SC);
+#endif
 
   void Rext_output_X();
 
+  // GetCalibParams stores wetm, drym, wetb, dryb, the wet and dry p and q,
+  // K_w and K_d in outp[0] to outp[9].
+  void GetCalibParams(number *outp);
+#ifndef SCPDSI_NO_R
   NumericVector Rext_out_params();
+  NumericMatrix Rext_out_coefs();
+  List Rext_out_vals();
+  static List Rext_vals_list(NumericVector *cols);
+  List Rext_out_diag();
+#endif
 
 private:
   //these variables keep track of what type of PDSI is being calculated.
@@ -199,6 +370,7 @@ private:
 
   int period_length;        //set to 1 for monthly, otherwise, legth of period
   int num_of_periods;       //number of periods of period_length in a year.
+  int status;               //pdsi_status of the current calculation
 
   // The variables used as flags to the pdsi class
   flag bug;
@@ -229,6 +401,12 @@ private:
   int nEndPeriodsToSkip;
   int nCalibrationPeriods;
   /* SG 6/5/06: End adding variables to allow user-defined calibration intervals */
+  // Sets the calibrating years, moved into the years of the series, and the
+  // numbers of years and periods that follow from them, flagging a move in
+  // warnings.
+  void SetCalibration(int calib_s_yr, int calib_e_yr);
+  // Makes up the sums of SumAll for the calibration interval from year_sums.
+  void SumYears();
 
 
   // Various constants used in calculations
@@ -314,30 +492,27 @@ private:
   number Q;     // Z needed for an end plus last period's V
 
   // These variables are statistical variables computed and output in
-  // verbose mode
+  // verbose mode.  All but DKSum are only filled in when pdsi_diagnostics
+  // is set.
   number DSSqr[52];
+  number DSAct[52];
+  number SPhat[52];
   number DEPSum[52];
   number DKSum;
   number SD;
   number SD2;
 
-  // linked lists to store X values for backtracking when computing X
-  llist Xlist;//final list of PDSI values
-  llist altX1;//list of X1 values
-  llist altX2;//list of X2 values
+  // series to store X values for backtracking when computing X
+  series Xlist;//final list of PDSI values
+  series altX1;//list of X1 values
+  series altX2;//list of X2 values
+  std::vector<int> altPos;//index in Xlist of each altX1/altX2 value
 
-  // These linked lists store the Z, Prob, and 3 X values for
-  // outputing the Z index, Hydro Palmer, and Weighted Palmer
-  llist XL1;
-  llist XL2;
-  llist XL3;
-  llist ProbL;
-  llist ZIND;
-  llist PeriodList;
-  llist YearList;
+  // The Z index, Prob, the 3 X values, the Hydro Palmer and the Weighted
+  // Palmer are kept in their result columns, vals[V_Z] to vals[V_WPLM].
 
-  // This linked list stores the CMI;
-  llist CMIList;
+  // This series stores the CMI;
+  series CMIList;
 
   //the directory path to the directory containing the input files
   char input_dir[128];
@@ -354,6 +529,8 @@ private:
   int GetTemp(FILE * In, number *A, int max); // Gets the Temp
   int GetPrecip(FILE *In, number *A, int max); // Gets the Precip
   void GetParam(FILE * Param);          // Gets Paramaters Su and TLA
+  // Gets a year of a series given by Load
+  void GetInput(const number *in, int year, number *A, int freq);
 
   // These functions calculate the Potentials needed
   // Calculates Potential Evapotranspiration from Thornthwaite
@@ -374,6 +551,20 @@ private:
   // and the X values.  Used for uncalibrated PDSI.
   void CalcZ();     // Calculates the Z-index
   void CalcX();     // Calculates the PDSI and X1, X2, and X3
+  void clearX();    // Empties the X lists before CalcX or CalcOrigK
+
+  // The functions above are instances of these, chosen by num_of_periods.
+  // NP, the number of periods per year, is a constant in each instance (12
+  // for monthly; 52, 26, 13 and 4 for 1, 2, 4 and 13 week periods), so the
+  // period loops and the row arithmetic use constants and the monthly
+  // instances have no weekly branches.
+  template<int NP> void SumAllNP();
+  template<int NP> void CalcWBCoefNP();
+  template<int NP> void CalcdNP();
+  template<int NP> void CalcKNP();
+  template<int NP> void CalcOrigKNP();
+  template<int NP> void CalcZNP();
+  template<int NP> void CalcXNP();
   //void CalcOneX(FILE* table, int period_number, int year);
   void CalcOneX(int period_number, int year);
   //calculates the PDSI and X1, X2, and X3 for one period.
@@ -388,6 +579,7 @@ private:
   // and replaces them with the appropriate value of X1 or X2
   // when necessary
   void Backtrack(number X1, number X2);
+  void StoreAltX(number newX1, number newX2);
   void ChooseX(number& newX, number& newX1, number& newX2,
                number& newX3, int bug);
 
@@ -403,7 +595,19 @@ private:
   // from the Z index.  These constants affect how much influence the Z index
   // has on the PDSI value.
   void CalcDurFact(number &slope, number &intercept, int sign);
-  number get_Z_sum(int length, int sign);
+  // This function finds the accumulated Z index of the wettest and driest
+  // spells of each length that CalcDurFact fits its line to.
+  void CalcZSums();
+  int dur_length[10];
+  number wet_Z_sum[10];
+  number dry_Z_sum[10];
+  std::vector<number> zsum_work;
+
+  // This function finds two percentiles of a series, skipping MISSING
+  // values.  pct_work is its workspace, kept between calls.
+  void CalcPercentiles(const series &L, int from, int to,
+                       double lower, double upper, number &lo, number &hi);
+  std::vector<number> pct_work;
   void LeastSquares(int *x, number *y, int n, int sign, number &slope, number &intercept);
 
   // This function writes the PDSI values
@@ -414,9 +618,25 @@ private:
   void MoveFiles(char *dir);
   int ReprintFile(char* src, char *des);
 
-  number getValue(llist &List, int period, int year);
-
-  number* getSubArray(llist &List, int start_per, int start_yr,
+  // getOffset returns the index of (period, year) in the per-period series,
+  // or -1 if that is not a valid period.  getLinear numbers the periods
+  // consecutively, so that the difference of two of them is the number of
+  // periods between them.
+  int getOffset(int period, int year);
+  int getLinear(int period, int year);
+  number getValue(const number *List, int size, int period, int year);
+  series_view getView(const number *List, int size,
+                      int start_per, int start_yr,
+                      int end_per, int end_yr);
+
+  // These functions derive the PHDI and WPLM of a period from its X values
+  // and the probability of the current spell ending.
+  number CalcPHDIValue(number x, number x3);
+  number CalcWPLMValue(number x1, number x2, number x3, number p);
+
+  number* copyArray(const number *List, int size);
+  number* getSubArray(const number *List, int list_size,
+                      int start_per, int start_yr,
                       int end_per, int end_yr, int &size);
 
   // These are simple functions to determine if the characters of a string
@@ -437,11 +657,20 @@ private:
 int dir_exists(char *dir);
 int create_dir(char *path);
 //-----------------------------------------------------------------------------
-//These three functions, partition(), select(), and exch() are used to select
-//the kth largest number in an array.
+//percentiles() selects two percentiles of an array in one pass using
+//introselect(), a quickselect that falls back to the median of medians so
+//that it is O(n) in the worst case.  The other functions are its helpers.
+//SELECT_STEPS is the number of median of three steps introselect() may take
+//without halving the values left before it turns to the median of medians.
 //-----------------------------------------------------------------------------
-void select(number a[], int l, int r, int k);
-int partition(number a[], int left, int right);
+#define SELECT_STEPS 3
+void percentiles(number a[], int n, double lower, double upper,
+                 number &lo, number &hi);
+number select_extreme(number a[], int n, int k);
+void introselect(number a[], int l, int r, int k, int steps);
+number median_of_medians(number a[], int l, int r);
+number median3(number x, number y, number z);
+void insertion_sort(number a[], int l, int r);
 void exch(number &x, number &y);
 //-----------------------------------------------------------------------------
 //The numEntries() function returns the number of entries in the file
@@ -449,4 +678,8 @@ void exch(number &x, number &y);
 //program allows that filename to be used in place of either wk_T_normal
 //or mon_T_normal.
 int numEntries(FILE *in);
+//-----------------------------------------------------------------------------
+//pdsi_status_message() describes a pdsi_status.
+//-----------------------------------------------------------------------------
+const char *pdsi_status_message(int status);
 #endif
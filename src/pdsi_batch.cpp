@@ -0,0 +1,193 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "pdsi_batch.h"
+#include "pdsi_threads.h"
+#include "wb_lanes.h"
+
+// Leaves the outputs of station i, which failed with status st, MISSING.
+static void pdsi_batch_fail(const pdsi_batch &b, int i, int st) {
+  size_t out = (size_t)i * b.np;
+
+  b.status[i] = st;
+  std::fill(b.X + out, b.X + out + b.np, MISSING);
+  std::fill(b.PHDI + out, b.PHDI + out + b.np, MISSING);
+  std::fill(b.WPLM + out, b.WPLM + out + b.np, MISSING);
+  std::fill(b.Z + out, b.Z + out + b.np, MISSING);
+  std::fill(b.clim_coes + (size_t)i * 60, b.clim_coes + (size_t)(i + 1) * 60,
+            MISSING);
+  std::fill(b.calib_coes + (size_t)i * 10,
+            b.calib_coes + (size_t)(i + 1) * 10, MISSING);
+  b.iters[i] = 0;
+}
+
+// Copies the results of station i out of its workspace PDSI.
+static void pdsi_batch_store(const pdsi_batch &b, pdsi &PDSI, int i) {
+  size_t out = (size_t)i * b.np;
+
+  b.status[i] = PDSI_OK;
+  std::copy(PDSI.vals[pdsi::V_X], PDSI.vals[pdsi::V_X] + b.np, b.X + out);
+  std::copy(PDSI.vals[pdsi::V_PHDI], PDSI.vals[pdsi::V_PHDI] + b.np,
+            b.PHDI + out);
+  std::copy(PDSI.vals[pdsi::V_WPLM], PDSI.vals[pdsi::V_WPLM] + b.np,
+            b.WPLM + out);
+  std::copy(PDSI.vals[pdsi::V_Z], PDSI.vals[pdsi::V_Z] + b.np, b.Z + out);
+  for(int j = 0; j < 5; j++)
+    std::copy(PDSI.coefs[j], PDSI.coefs[j] + 12,
+              b.clim_coes + (size_t)i * 60 + j * 12);
+  PDSI.GetCalibParams(b.calib_coes + (size_t)i * 10);
+  b.iters[i] = PDSI.calib_iter;
+}
+
+// Calculates the block of isa.width stations from first with the
+// workspaces ws, one per lane.  The water balance of the block runs in the
+// lanes of the kernel of isa, and each station is finished on its own.
+static void pdsi_batch_block(const pdsi_batch &b, const wb_isa &isa,
+                             pdsi *ws, std::vector<number> &work, int first) {
+  pdsi *lane[8];
+
+  for(int l = 0; l < isa.width; l++) {
+    int i = first + l;
+    lane[l] = NULL;
+    if(i >= b.nst)
+      continue;
+
+    size_t in = b.shared_input ? 0 : (size_t)i * b.nmon;
+    int st = ws[l].Load(b.P + in, b.PE + in, b.nmon, b.AWC[i],
+                        b.s_yr, b.e_yr, b.calib_s_yr[i], b.calib_e_yr[i]);
+    b.warnings[i] = ws[l].warnings;
+    if(st != PDSI_OK) {
+      pdsi_batch_fail(b, i, st);
+      continue;
+    }
+    ws[l].PDSI_mon_setup();
+    lane[l] = &ws[l];
+  }
+
+  pdsi::SumAllLanes(lane, b.e_yr - b.s_yr + 1, isa, work);
+
+  for(int l = 0; l < isa.width; l++) {
+    if(!lane[l])
+      continue;
+    int st = ws[l].PDSI_mon_finish(b.sc);
+    if(st == PDSI_OK)
+      pdsi_batch_store(b, ws[l], first + l);
+    else
+      pdsi_batch_fail(b, first + l, st);
+  }
+}
+
+// Each thread takes the stations a block at a time from next until none is
+// left.  The stations a thread is left without memory for keep the status
+// PDSI_ERR_MEMORY set by pdsi_run_batch, which fails them at the end.
+static void pdsi_batch_worker(const pdsi_batch &b, std::atomic<int> &next) {
+  const wb_isa &isa = wb_lanes_isa();
+  const int W = isa.width;
+  try {
+    std::vector<pdsi> ws(W);
+    std::vector<number> work;
+    for(int l = 0; l < W; l++) {
+      ws[l].Defaults();
+      ws[l].Rext_set_parcoefs(b.K1_1, b.K1_2, b.K1_3, b.K2, b.p, b.q);
+      ws[l].Rext_set_calib(b.calib_iter, b.calib_tol);
+      ws[l].Reserve(b.e_yr - b.s_yr + 1);
+    }
+
+    for(int first = next.fetch_add(W); first < b.nst;
+        first = next.fetch_add(W))
+      pdsi_batch_block(b, isa, &ws[0], work, first);
+  } catch(std::bad_alloc &) {
+  }
+}
+
+// Stations of a single series with the same AWC differ only in their
+// calibrating years, so they can share one water balance.
+static bool pdsi_batch_shares_wb(const pdsi_batch &b) {
+  if(!b.shared_input || b.nst < 2)
+    return false;
+  for(int i = 1; i < b.nst; i++)
+    if(b.AWC[i] != b.AWC[0])
+      return false;
+  return true;
+}
+
+// Each thread takes the stations one at a time from next and calculates
+// them in its copy of base, the series after SumAll, recalibrated for each,
+// leaving those it has no memory for to pdsi_run_batch as above.
+static void pdsi_batch_shared_worker(const pdsi_batch &b, const pdsi &base,
+                                     std::atomic<int> &next) {
+  try {
+    pdsi PDSI;
+    PDSI.Copy(base);
+
+    for(int i = next.fetch_add(1); i < b.nst; i = next.fetch_add(1)) {
+      int st = PDSI.Recalibrate(b.calib_s_yr[i], b.calib_e_yr[i]);
+      b.warnings[i] = PDSI.warnings;
+      if(st == PDSI_OK)
+        st = PDSI.PDSI_mon_finish(b.sc);
+      if(st == PDSI_OK)
+        pdsi_batch_store(b, PDSI, i);
+      else
+        pdsi_batch_fail(b, i, st);
+    }
+  } catch(std::bad_alloc &) {
+  }
+}
+
+int pdsi_run_batch(const pdsi_batch &b, int nthreads) {
+  std::atomic<int> next(0);
+
+  for(int i = 0; i < b.nst; i++) {
+    b.status[i] = PDSI_ERR_MEMORY;
+    b.warnings[i] = 0;
+  }
+
+  nthreads = pdsi_num_threads(nthreads, b.nst);
+
+  if(pdsi_batch_shares_wb(b)) {
+    // the water balance of the series, calibrated over all its years, with
+    // what each year adds to the sums
+    pdsi base;
+    int st;
+    try {
+      base.Defaults();
+      base.Rext_set_parcoefs(b.K1_1, b.K1_2, b.K1_3, b.K2, b.p, b.q);
+      base.Rext_set_calib(b.calib_iter, b.calib_tol);
+      base.keep_year_sums = true;
+      st = base.Load(b.P, b.PE, b.nmon, b.AWC[0], b.s_yr, b.e_yr,
+                     b.s_yr, b.e_yr);
+      if(st == PDSI_OK)
+        st = base.PDSI_mon_sums();
+    } catch(std::bad_alloc &) {
+      st = PDSI_ERR_MEMORY;
+    }
+    if(st != PDSI_OK) {
+      for(int i = 0; i < b.nst; i++)
+        pdsi_batch_fail(b, i, st);
+      return b.nst;
+    }
+    pdsi_on_threads(nthreads, [&](int) {
+      pdsi_batch_shared_worker(b, base, next);
+    });
+  } else {
+    pdsi_on_threads(nthreads, [&](int) {
+      pdsi_batch_worker(b, next);
+    });
+  }
+
+  // a station is still PDSI_ERR_MEMORY if a thread ran out of memory
+  // before storing it, so its outputs are not written yet
+  int failed = 0;
+  for(int i = 0; i < b.nst; i++) {
+    if(b.status[i] == PDSI_ERR_MEMORY)
+      pdsi_batch_fail(b, i, PDSI_ERR_MEMORY);
+    if(b.status[i] != PDSI_OK)
+      failed++;
+  }
+  return failed;
+}
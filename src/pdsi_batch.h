@@ -0,0 +1,55 @@
+#ifndef PDSI_BATCH_H
+#define PDSI_BATCH_H
+
+#include "pdsi.h"
+
+//-----------------------------------------------------------------------------
+// pdsi_batch describes the monthly (sc)PDSI of many stations sharing the same
+// years.  Every input and output holds one column per station, column-major,
+// and is owned by the caller.
+//-----------------------------------------------------------------------------
+struct pdsi_batch {
+  // Inputs
+  const number *P;        // Precipitation, nmon x nst
+  const number *PE;       // Potential evapotranspiration, nmon x nst
+  int nmon;               // Number of months of input of each station
+  int nst;                // Number of stations
+  bool shared_input;      // P and PE are a single column used by every
+                          // station, e.g. to sweep over AWC
+  const number *AWC;      // Available water capacity of each station
+  const int *calib_s_yr;  // Calibrating start year of each station
+  const int *calib_e_yr;  // Calibrating end year of each station
+  int s_yr;
+  int e_yr;
+  bool sc;
+  number K1_1, K1_2, K1_3, K2, p, q;
+  int calib_iter;
+  number calib_tol;
+
+  // Outputs
+  int np;                 // Periods of each station, (e_yr - s_yr + 1) * 12
+  number *X;              // PDSI, np x nst
+  number *PHDI;           // PHDI, np x nst
+  number *WPLM;           // Weighted PDSI, np x nst
+  number *Z;              // Z index, np x nst
+  number *clim_coes;      // alpha, beta, gamma, delta and K1, 12 x 5 x nst
+  number *calib_coes;     // Rext_out_params of each station, 10 x nst
+  int *iters;             // Passes of the self-calibration of each station
+  int *status;            // pdsi_status of each station
+  int *warnings;          // pdsi_warning flags of each station
+};
+
+//-----------------------------------------------------------------------------
+// pdsi_run_batch calculates the stations of b on nthreads threads, or on
+// every core when nthreads < 1, and returns the number of stations that
+// failed.  Each thread keeps its own workspaces and takes the next block of
+// stations as soon as it is done with one, since the time a station takes
+// varies with its missing data and spells.  The water balance of a block
+// runs with one station per SIMD lane (SumAllLanes) with the kernel of
+// wb_lanes_isa.  Stations of a shared input with the same AWC, which differ
+// only in their calibrating years, share a single water balance instead,
+// and each is recalibrated from it (Recalibrate).  It does not call into R.
+//-----------------------------------------------------------------------------
+int pdsi_run_batch(const pdsi_batch &b, int nthreads);
+
+#endif
@@ -0,0 +1,58 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "pdsi_boot.h"
+#include "pdsi_threads.h"
+
+// Calculates the replicates taken from next with the workspace PDSI,
+// leaving the status of each in status.
+static void boot_worker(const pdsi_boot &b, pdsi *PDSI, int *status,
+                        std::atomic<int> &next) {
+  for(int r = next.fetch_add(1); r < b.nboot; r = next.fetch_add(1)) {
+    try {
+      status[r] = PDSI->LoadYears(*b.base, b.years + (size_t)r * b.nyears,
+                                  b.nyears);
+      if(status[r] == PDSI_OK) {
+        PDSI->PDSI_mon_coefs();
+        status[r] = PDSI->PDSI_mon_index(true);
+      }
+    } catch(std::bad_alloc &) {
+      status[r] = PDSI_ERR_MEMORY;
+    }
+    if(status[r] == PDSI_OK) {
+      PDSI->GetCalibParams(b.calib_coes + (size_t)r * 10);
+      b.iters[r] = PDSI->calib_iter;
+    }
+  }
+}
+
+int pdsi_run_boot(const pdsi_boot &b, int nthreads) {
+  nthreads = pdsi_num_threads(nthreads, b.nboot);
+
+  std::vector<pdsi> ws;
+  std::vector<int> status;
+  try {
+    ws.resize(nthreads);
+    // the coefficients and the options of the self-calibration
+    for(int t = 0; t < nthreads; t++)
+      ws[t].Copy(*b.base);
+    status.assign(b.nboot, PDSI_ERR_MEMORY);
+  } catch(std::bad_alloc &) {
+    return PDSI_ERR_MEMORY;
+  }
+
+  std::atomic<int> next(0);
+  pdsi_on_threads(nthreads, [&](int t) {
+    boot_worker(b, &ws[t], &status[0], next);
+  });
+
+  for(int r = 0; r < b.nboot; r++)
+    if(status[r] != PDSI_OK)
+      return status[r];
+  return PDSI_OK;
+}
@@ -0,0 +1,36 @@
+#ifndef PDSI_BOOT_H
+#define PDSI_BOOT_H
+
+#include "pdsi.h"
+
+//-----------------------------------------------------------------------------
+// pdsi_boot describes a bootstrap of the self-calibration of one series.
+// Each replicate is the scPDSI of a record made of resampled years of the
+// series, calibrated over all of them, of which only the calibrating
+// coefficients are kept.  Every input and output is owned by the caller.
+//-----------------------------------------------------------------------------
+struct pdsi_boot {
+  // Inputs
+  const pdsi *base;       // Workspace of the series after SumAll with
+                          // keep_year_sums set
+  const int *years;       // The years of each replicate, 0 for the first
+                          // year of the series, nyears x nboot
+  int nyears;
+  int nboot;
+
+  // Outputs
+  number *calib_coes;     // GetCalibParams of each replicate, 10 x nboot
+  int *iters;             // Self-calibration passes of each replicate
+};
+
+//-----------------------------------------------------------------------------
+// pdsi_run_boot calculates the replicates of b on nthreads threads (every
+// core when nthreads < 1), each with its own copy of b.base loaded with
+// LoadYears, so that no replicate runs the water balance.  The replicates
+// do not depend on each other, so neither do the results on the number of
+// threads.  Returns the pdsi_status of the first replicate that failed, or
+// PDSI_OK, and does not call into R.
+//-----------------------------------------------------------------------------
+int pdsi_run_boot(const pdsi_boot &b, int nthreads);
+
+#endif
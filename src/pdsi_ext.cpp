@@ -1,48 +1,269 @@
 #include "pdsi.h"
+#include <math.h>
 
-void pdsi::Rext_init(NumericVector& P, NumericVector& PE,
-                     number o_AWC,
-                     int s_yr, int e_yr,
-                     int calib_s_yr, int calib_e_yr) {
-  int nPeriods;
-  int input_len = P.length();
+void pdsi::Defaults() {
   metric = 1;
   verbose = 0;
   num_of_periods = 12;
 
+  coe_K1_1 = 1.5;
+  coe_K1_2 = 2.8;
+  coe_K1_3 = 0.5;
+  coe_K2 = 17.67;
+
+  coe_p = 0.897;
+  coe_q = 1./3.;
+
+  coe_m = (1-coe_p)/coe_q;
+  coe_b = coe_p/coe_q;
+
+  calib_max_iter = 3;
+  calib_tol = 0;
+  calib_iter = 0;
+}
+
+void pdsi::Reserve(int max_years) {
+  int max_periods = max_years * num_of_periods;
+  if(max_periods > nValsPeriods) {
+    nValsPeriods = max_periods;
+    for(int i = 0; i < N_VALS; i++) {
+      vals_col[i].resize(max_periods);
+      vals[i] = &vals_col[i][0];
+    }
+  }
+  if(max_periods <= nReservedPeriods)
+    return;
+
+  nReservedPeriods = max_periods;
+  // every per-period series holds one value per period of the record
+  Xlist.reserve(max_periods);
+  altX1.reserve(max_periods);
+  altX2.reserve(max_periods);
+  altPos.reserve(max_periods);
+  pct_work.reserve(max_periods);
+  zsum_work.reserve(2 * (max_periods + 1));
+}
+
+void pdsi::Copy(const pdsi &src) {
+  *this = src;
+  // vals must point at the columns of this workspace, not at those of src
+  // or at the columns bound to it
+  for(int i = 0; i < N_VALS; i++) {
+    if(src.vals[i] && (src.vals_col[i].empty() ||
+                       src.vals[i] != &src.vals_col[i][0]))
+      vals_col[i].assign(src.vals[i], src.vals[i] + src.nValsPeriods);
+    vals[i] = vals_col[i].empty() ? NULL : &vals_col[i][0];
+  }
+  nValsPeriods = (int)vals_col[0].size();
+}
+
+void pdsi::BindVals(number *const *cols, int nperiods) {
+  for(int i = 0; i < N_VALS; i++)
+    vals[i] = cols[i];
+  nValsPeriods = nperiods;
+}
+
+int pdsi::Load(const number *P, const number *PE, int len,
+               number o_AWC,
+               int s_yr, int e_yr,
+               int calib_s_yr, int calib_e_yr) {
+  warnings = 0;
+
   if(s_yr >= e_yr)
-    Rf_error("Start year (%d) must earlier than end year (%d).", s_yr, e_yr);
+    return PDSI_ERR_YEARS;
 
   if(calib_s_yr >= calib_e_yr)
-    Rf_error("Calibrating start year (%d) must earlier than "
-             "calibrating end year (%d).", calib_s_yr, calib_e_yr);
+    return PDSI_ERR_CALIB_YEARS;
 
   startyear = s_yr;
   endyear = e_yr;
   s_year = s_yr;
   e_year = e_yr;
+  totalyears = endyear - startyear + 1;
+  nPeriods = totalyears * num_of_periods;
+  SetCalibration(calib_s_yr, calib_e_yr);
+
+  if((int)ceil(len * 1. / num_of_periods) < totalyears)
+    return PDSI_ERR_SHORT;
+
+  AWC = o_AWC / 25.4;
+
+  Ss = 1.0;
+  if(AWC < Ss){
+    AWC = Ss;
+  }
+  Su = AWC - Ss;
+  if(Su < 0)
+    Su = 0;
+
+  P_in = P;
+  PE_in = PE;
+  input_len = len;
+  Reserve(totalyears);
+
+  // nothing of the previous series should be readable through the getters
+  Xlist.clear();
+  altX1.clear();
+  altX2.clear();
+  altPos.clear();
+
+  K_w = 1.;
+  K_d = 1.;
+  calib_iter = 0;
+  return PDSI_OK;
+}
+
+int pdsi::LoadYears(const pdsi &src, const int *years, int nyears) {
+  const int NP = src.num_of_periods;
+  warnings = 0;
+
+  if(nyears < 2)
+    return PDSI_ERR_CALIB_YEARS;
+  for(int y = 0; y < nyears; y++)
+    if(years[y] < 0 || years[y] >= src.totalyears)
+      return PDSI_ERR_SHORT;
+  if(src.year_sums.size() < (size_t)src.totalyears * N_SUMS * NP)
+    return PDSI_ERR_SHORT;
+
+  // the whole record is the calibration interval
+  num_of_periods = NP;
+  startyear = s_year = 1;
+  endyear = e_year = nyears;
+  totalyears = nyears;
+  nPeriods = totalyears * num_of_periods;
+  SetCalibration(1, nyears);
+  AWC = src.AWC;
+  P_in = PE_in = NULL;
+  input_len = 0;
+  Reserve(totalyears);
+  PDSI_mon_setup();
+
+  Xlist.clear();
+  altX1.clear();
+  altX2.clear();
+  altPos.clear();
+
+  // the years of src in their order give the sums of SumAll
+  year_sums.resize((size_t)nyears * N_SUMS * NP);
+  for(int y = 0; y < nyears; y++) {
+    size_t from = (size_t)years[y] * NP, to = (size_t)y * NP;
+    for(int i = V_P; i <= V_PL; i++)
+      std::copy(src.vals[i] + from, src.vals[i] + from + NP, vals[i] + to);
+    std::copy(&src.year_sums[from * N_SUMS],
+              &src.year_sums[from * N_SUMS] + N_SUMS * NP,
+              &year_sums[to * N_SUMS]);
+  }
+  SumYears();
+
+  K_w = 1.;
+  K_d = 1.;
+  calib_iter = 0;
+  return status;
+}
+
+int pdsi::Recalibrate(int calib_s_yr, int calib_e_yr) {
+  warnings = 0;
+
+  if(calib_s_yr >= calib_e_yr)
+    return PDSI_ERR_CALIB_YEARS;
+  if(year_sums.size() < (size_t)totalyears * N_SUMS * num_of_periods)
+    return PDSI_ERR_SHORT;
+
+  SetCalibration(calib_s_yr, calib_e_yr);
+  PDSI_mon_setup();
+  SumYears();
+
+  Xlist.clear();
+  altX1.clear();
+  altX2.clear();
+  altPos.clear();
+
+  K_w = 1.;
+  K_d = 1.;
+  calib_iter = 0;
+  return status;
+}
+
+void pdsi::CumYearSums() {
+  const size_t row = (size_t)N_SUMS * num_of_periods;
+
+  year_cum.resize((totalyears + 1) * row);
+  year_missing.resize(totalyears + 1);
+  std::fill(year_cum.begin(), year_cum.begin() + row, 0.0);
+  year_missing[0] = 0;
+  for(int y = 0; y < totalyears; y++) {
+    for(size_t j = 0; j < row; j++)
+      year_cum[(y + 1) * row + j] = year_cum[y * row + j] +
+        year_sums[y * row + j];
+    int missing = 0;
+    for(int per = 0; per < num_of_periods; per++)
+      if(vals[V_P][y * num_of_periods + per] == MISSING)
+        missing++;
+    year_missing[y + 1] = year_missing[y] + missing;
+  }
+}
+
+int pdsi::ClimCoefs(int calib_s_yr, int calib_e_yr) {
+  const int NP = num_of_periods;
+  const size_t row = (size_t)N_SUMS * NP;
+  number *sums[N_SUMS] = { ETSum, RSum, ROSum, LSum, PSum, PESum, PRSum,
+                           PROSum, PLSum };
+  warnings = 0;
+
+  if(calib_s_yr >= calib_e_yr)
+    return PDSI_ERR_CALIB_YEARS;
+  if(year_cum.size() < (totalyears + 1) * row ||
+     year_missing.size() < (size_t)totalyears + 1)
+    return PDSI_ERR_SHORT;
+
+  SetCalibration(calib_s_yr, calib_e_yr);
+  // a window wholly outside the years has no row of year_cum
+  if(nCalibrationYears < 1 || nStartYearsToSkip >= totalyears)
+    return PDSI_ERR_CALIB_YEARS;
+  PDSI_mon_setup();
+
+  const int end = nStartYearsToSkip + nCalibrationYears;
+  const number *from = &year_cum[nStartYearsToSkip * row];
+  const number *to = &year_cum[end * row];
+  for(int j = 0; j < N_SUMS; j++)
+    for(int per = 0; per < NP; per++)
+      sums[j][per] = to[j * NP + per] - from[j * NP + per];
+
+  // the periods without data are made up after the end, as in SumYears
+  int left = year_missing[end] - year_missing[nStartYearsToSkip];
+  for(int y = end; y < totalyears && left > 0; y++) {
+    const number *ys = &year_sums[y * row];
+    for(int per = 0; per < NP && left > 0; per++) {
+      if(vals[V_P][y * NP + per] == MISSING)
+        continue;
+      left--;
+      for(int j = 0; j < N_SUMS; j++)
+        sums[j][per] += ys[j * NP + per];
+    }
+  }
+
+  // d depends on the coefficients, so D still takes a pass over the periods
+  PDSI_mon_coefs();
+  CalcK();
+  return status;
+}
+
+void pdsi::SetCalibration(int calib_s_yr, int calib_e_yr) {
   calibrationStartYear = calib_s_yr;
   calibrationEndYear = calib_e_yr;
 
-  if(input_len != PE.length())
-    Rf_error("Length of input P (%d) is not equal to input PE (%d).",
-             input_len, PE.length());
-
   if(calibrationStartYear < startyear) {
-    Rf_warning("Calibrating start year (%d) is earlier than start year (%d), "
-               "it would be set as start year.", calib_s_yr, s_yr);
+    warnings |= PDSI_WARN_CALIB_START;
     calibrationStartYear = startyear;
   }
   if(calibrationEndYear > endyear) {
-    Rf_warning("Calibrating end year (%d) is later than end year (%d), "
-                 "it would be set as end year.", calib_e_yr, e_yr);
+    warnings |= PDSI_WARN_CALIB_END;
     calibrationEndYear = endyear;
   }
 
   setCalibrationStartYear = 1;
   setCalibrationEndYear = 1;
 
-  totalyears = endyear - startyear + 1;
   currentCalibrationStartYear = calibrationStartYear;
   currentCalibrationEndYear = calibrationEndYear;
   nStartYearsToSkip = currentCalibrationStartYear - startyear;
@@ -52,43 +273,99 @@ void pdsi::Rext_init(NumericVector& P, NumericVector& PE,
   nStartPeriodsToSkip = nStartYearsToSkip * num_of_periods;
   nEndPeriodsToSkip = nEndYearsToSkip * num_of_periods;
   nCalibrationPeriods = nCalibrationYears * num_of_periods;
-  nPeriods = totalyears * num_of_periods;
+}
 
-  if((int)ceil(input_len * 1. / num_of_periods) < totalyears)
-    Rf_error("Years of input P (%d years) should not shorter than"
-             "years of output settings (%d years).",
-             (int)ceil(input_len * 1. / num_of_periods),
-             totalyears);
+void pdsi::SumYears() {
+  const int NP = num_of_periods;
+  number *sums[N_SUMS] = { ETSum, RSum, ROSum, LSum, PSum, PESum, PRSum,
+                           PROSum, PLSum };
+
+  for(int j = 0; j < N_SUMS; j++)
+    std::fill(sums[j], sums[j] + NP, 0.0);
+
+  // As in SumAll, the interval counts only the periods with data, so one
+  // without is made up after its end, and the periods are added in order.
+  int left = nCalibrationPeriods;
+  for(int y = nStartYearsToSkip; y < totalyears && left > 0; y++) {
+    const number *ys = &year_sums[(size_t)y * N_SUMS * NP];
+    for(int per = 0; per < NP && left > 0; per++) {
+      if(vals[V_P][y * NP + per] == MISSING)
+        continue;
+      left--;
+      for(int j = 0; j < N_SUMS; j++)
+        sums[j][per] += ys[j * NP + per];
+    }
+  }
+}
 
-  AWC = o_AWC / 25.4;
+#ifndef SCPDSI_NO_R
+void pdsi::Rext_init(NumericVector& P, NumericVector& PE,
+                     number o_AWC,
+                     int s_yr, int e_yr,
+                     int calib_s_yr, int calib_e_yr) {
+  Defaults();
+  Rext_reset(P, PE, o_AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
+}
 
-  Ss = 1.0;
-  if(AWC < Ss){
-    AWC = Ss;
-  }
-  Su = AWC - Ss;
-  if(Su < 0)
-    Su = 0;
+void pdsi::Rext_reset(NumericVector& P, NumericVector& PE,
+                      number o_AWC,
+                      int s_yr, int e_yr,
+                      int calib_s_yr, int calib_e_yr) {
+  int input_len = P.length();
 
-  P_vec = P;
-  PE_vec = PE;
-  //d_vec = NumericVector(nPeriods);
-  //Z_vec = NumericVector(nPeriods);
-  vals_mat = NumericMatrix(nPeriods, 16);
-  coefs_mat = NumericMatrix(12, 5);
-  K_w = 1.;
-  K_d = 1.;
+  if(input_len != PE.length())
+    Rf_error("Length of input P (%d) is not equal to input PE (%d).",
+             input_len, PE.length());
 
-  coe_K1_1 = 1.5;
-  coe_K1_2 = 2.8;
-  coe_K1_3 = 0.5;
-  coe_K2 = 17.67;
+  int st = Load(P.begin(), PE.begin(), input_len, o_AWC,
+                s_yr, e_yr, calib_s_yr, calib_e_yr);
+  switch(st) {
+  case PDSI_OK:
+    break;
+  case PDSI_ERR_YEARS:
+    Rf_error("Start year (%d) must earlier than end year (%d).", s_yr, e_yr);
+  case PDSI_ERR_CALIB_YEARS:
+    Rf_error("Calibrating start year (%d) must earlier than "
+             "calibrating end year (%d).", calib_s_yr, calib_e_yr);
+  case PDSI_ERR_SHORT:
+    Rf_error("Years of input P (%d years) should not shorter than"
+             "years of output settings (%d years).",
+             (int)ceil(input_len * 1. / num_of_periods),
+             e_yr - s_yr + 1);
+  default:
+    Rf_error("%s", pdsi_status_message(st));
+  }
 
-  coe_p = 0.897;
-  coe_q = 1./3.;
+  if(warnings & PDSI_WARN_CALIB_START)
+    Rf_warning("Calibrating start year (%d) is earlier than start year (%d), "
+               "it would be set as start year.", calib_s_yr, s_yr);
+  if(warnings & PDSI_WARN_CALIB_END)
+    Rf_warning("Calibrating end year (%d) is later than end year (%d), "
+                 "it would be set as end year.", calib_e_yr, e_yr);
+}
+#endif
+
+const char *pdsi_status_message(int status) {
+  switch(status) {
+  case PDSI_OK:
+    return "No error.";
+  case PDSI_ERR_YEARS:
+    return "Start year must earlier than end year.";
+  case PDSI_ERR_CALIB_YEARS:
+    return "Calibrating start year must earlier than calibrating end year.";
+  case PDSI_ERR_SHORT:
+    return "Years of input P should not shorter than years of output settings.";
+  case PDSI_ERR_PERIODS:
+    return "Unsupported number of periods per year.";
+  case PDSI_ERR_MEMORY:
+    return "Not enough memory for the calculation.";
+  }
+  return "Unknown error.";
+}
 
-  coe_m = (1-coe_p)/coe_q;
-  coe_b = coe_p/coe_q;
+void pdsi::Rext_set_calib(int max_iter, number tol) {
+  calib_max_iter = max_iter;
+  calib_tol = tol;
 }
 
 void pdsi::Rext_set_parcoefs(number K1_1, number K1_2, number K1_3, number K2,
@@ -105,11 +382,11 @@ void pdsi::Rext_set_parcoefs(number K1_1, number K1_2, number K1_3, number K2,
   coe_b = coe_p/coe_q;
 }
 
-void pdsi::Rext_get_Rvec(NumericVector R_vec, int year, number* A, int freq) {
-  int rng = min(freq, R_vec.length() - (year - 1) * freq);
+void pdsi::GetInput(const number *in, int year, number* A, int freq) {
+  int rng = min(freq, input_len - (year - 1) * freq);
   for(int i = 0; i < freq; i++) {
     if(i < rng)
-      A[i] = R_vec[(year - 1) * freq + i];
+      A[i] = in[(year - 1) * freq + i];
     else
       A[i] = MISSING;
 
@@ -120,11 +397,33 @@ void pdsi::Rext_get_Rvec(NumericVector R_vec, int year, number* A, int freq) {
 
 }
 
+#ifndef SCPDSI_NO_R
 void pdsi::Rext_PDSI_mon(bool sc) {
-  int i;
+  int st = PDSI_mon(sc);
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+}
+#endif
+
+int pdsi::PDSI_mon(bool sc) {
+  int st = PDSI_mon_sums();
+  if(st != PDSI_OK)
+    return st;
+  return PDSI_mon_finish(sc);
+}
+
+int pdsi::PDSI_mon_sums() {
+  PDSI_mon_setup();
+  // SumAll is called to compute the sums for the 8 water balance variables
+  SumAll();
+  return status;
+}
+
+void pdsi::PDSI_mon_setup() {
   //FILE *param;
   //char filename[170];
 
+  status = PDSI_OK;
   SCMonthly = true;
   Monthly = false;
   Weekly = false;
@@ -201,8 +500,15 @@ void pdsi::Rext_PDSI_mon(bool sc) {
   if(verbose>1)
     printf ("processing station 1\n");
    */
-  // SumAll is called to compute the sums for the 8 water balance variables
-  SumAll();
+}
+
+int pdsi::PDSI_mon_finish(bool sc) {
+  PDSI_mon_coefs();
+  return PDSI_mon_index(sc);
+}
+
+void pdsi::PDSI_mon_coefs() {
+  int i;
   // This outputs those sums to the screen
   /*
   //if(verbose>1) {
@@ -211,7 +517,7 @@ void pdsi::Rext_PDSI_mon(bool sc) {
     printf ("%4s %7s %8s %8s %8s %8s %8s %8s %8s %8s %10s", "PER", "P", "S", "PR", "PE", "PL", "ET", "R", "L", "RO", "DEP\n\n");
   //}
   */
-  for (i = 0;i < num_of_periods;i++) {
+  for (i = 0;i < num_of_periods && pdsi_diagnostics;i++) {
     /* DEPSum will only include calibration interval data since the ET, R, PE, and RO
     ** sum variables only include data from the calibration interval.
     */
@@ -234,6 +540,9 @@ void pdsi::Rext_PDSI_mon(bool sc) {
   CalcWBCoef();
   // Next Calcd is called to calculate the monthly departures from normal
   Calcd();
+}
+
+int pdsi::PDSI_mon_index(bool sc) {
   // CalcK is called to compute the K values
   /* These variables will only include calibration interval data since the other
   ** sum variables only include data from the calibration interval--set in SumALL().
@@ -251,6 +560,7 @@ void pdsi::Rext_PDSI_mon(bool sc) {
       printf("\nCalibrating Index.\n");
      */
     //calculate the duration factors
+    CalcZSums();
     CalcDurFact(wetm, wetb, 1);
     CalcDurFact(drym, dryb, -1);
     /*
@@ -264,9 +574,16 @@ void pdsi::Rext_PDSI_mon(bool sc) {
      */
     //Calculate the PDSI values
     CalcX();
-    //Calibrate the Index
-    for(int i = 0; i < 3; i++)
+    //Calibrate the Index.  Each pass rescales Z in place and recomputes X
+    //once; stop early once both ratios are within calib_tol of 1.
+    calib_iter = 0;
+    while(calib_iter < calib_max_iter) {
       Calibrate();
+      calib_iter++;
+      if(calib_tol > 0 && fabs(wet_ratio - 1) <= calib_tol &&
+         fabs(dry_ratio - 1) <= calib_tol)
+        break;
+    }
     // Now that all calculations have been done they can be output to the screen
     /* SG 6/5/06: changed totalyears to nCalibrationYears means to support
      **            user defined calibration intervals. When not used
@@ -302,59 +619,26 @@ void pdsi::Rext_PDSI_mon(bool sc) {
   }
 */
   Rext_output_X();
+  return status;
 }
 
 
 void pdsi::Rext_output_X() {
-  int n = 0;
-  number x, x1, x2, x3, p, wp, ph;
-  llist tempX, tempX1, tempX2, tempX3, tempP;
-  copy(tempX, Xlist);
-  copy(tempX1, XL1);
-  copy(tempX2, XL2);
-  copy(tempX3, XL3);
-  copy(tempP, ProbL);
-
-  while(!tempX.is_empty() && n < vals_mat.nrow()) {
-    x = tempX.tail_remove();
-    x1 = tempX1.tail_remove();
-    x2 = tempX2.tail_remove();
-    x3 = tempX3.tail_remove();
-    p = tempP.tail_remove()/100.;
-
-    ph = x3;
-    if (x3==0) {
-      // There is not an established wet or dry spell so PHDI = PDSI (ph=x)
-      // and the WPLM value is the maximum absolute value of X1 or X2
-      ph = x;
-      wp = x1;
-      if (-x2 > (x1 + tolerance))
-        wp=x2;
-    }
-    else if (p > (0+tolerance/100) && p < (1-tolerance/100)) {
-      // There is an established spell but there is a possibility it has or is
-      // ending.  The WPLM is then a weighted average between X3 and X1 or X2
-      if (x3 < 0)
-        // X3 is negative so WPLM is weighted average of X3 and X1
-        wp = (1-p)*x3 + p*x1;
-      else
-        // X3 is positive so WPLM is weighted average of X3 and X2
-        wp = (1-p)*x3 + p*x2;
-    }
-    else
-      // There is an established spell without possibility of end meaning the
-      // WPLM is simply X3
-      wp=x3;
-
-    vals_mat(n, 13) = x;
-    vals_mat(n, 14) = ph;
-    vals_mat(n, 15) = wp;
-    n++;
+  for(int n = 0; n < Xlist.get_size() && n < nPeriods; n++) {
+    vals[V_X][n] = Xlist[n];
   }
 }
 
+#ifndef SCPDSI_NO_R
 NumericVector pdsi::Rext_out_params() {
   NumericVector outp(10);
+  GetCalibParams(outp.begin());
+
+  return outp;
+}
+#endif
+
+void pdsi::GetCalibParams(number *outp) {
   outp[0] = wetm;
   outp[1] = drym;
   outp[2] = wetb;
@@ -365,6 +649,52 @@ NumericVector pdsi::Rext_out_params() {
   outp[7] = 1/(drym+dryb);
   outp[8] = K_w;
   outp[9] = K_d;
+}
 
-  return outp;
+#ifndef SCPDSI_NO_R
+// Rext_out_coefs returns alpha, beta, gamma, delta and K1 of each period
+// as the columns of a matrix.
+NumericMatrix pdsi::Rext_out_coefs() {
+  NumericMatrix out(num_of_periods, 5);
+  for(int j = 0; j < 5; j++)
+    for(int per = 0; per < num_of_periods; per++)
+      out(per, j) = coefs[j][per];
+
+  return out;
+}
+
+List pdsi::Rext_out_vals() {
+  NumericVector out[N_VALS];
+
+  for(int i = 0; i < N_VALS; i++)
+    out[i] = NumericVector(vals[i], vals[i] + nPeriods);
+
+  return Rext_vals_list(out);
+}
+
+// Rext_vals_list names the result columns out[V_P] to out[V_WPLM] as
+// Rext_out_vals does, e.g. those bound with BindVals.
+List pdsi::Rext_vals_list(NumericVector *out) {
+  return List::create(Named("P") = out[V_P], Named("PE") = out[V_PE],
+                      Named("PR") = out[V_PR], Named("PRO") = out[V_PRO],
+                      Named("PL") = out[V_PL], Named("d") = out[V_d],
+                      Named("Z") = out[V_Z], Named("Prob") = out[V_Prob],
+                      Named("X1") = out[V_X1], Named("X2") = out[V_X2],
+                      Named("X3") = out[V_X3], Named("X") = out[V_X],
+                      Named("PHDI") = out[V_PHDI], Named("WPLM") = out[V_WPLM]);
+}
+
+// Rext_out_diag returns the statistics that are only accumulated in a
+// diagnostic build, one value per period for DSSqr, DSAct, SPhat and DEPSum.
+// SD and SD2 are the sum and the sum of squares of the late summer departures.
+List pdsi::Rext_out_diag() {
+  NumericVector dssqr(DSSqr, DSSqr + num_of_periods);
+  NumericVector dsact(DSAct, DSAct + num_of_periods);
+  NumericVector sphat(SPhat, SPhat + num_of_periods);
+  NumericVector depsum(DEPSum, DEPSum + num_of_periods);
+
+  return List::create(Named("DSSqr") = dssqr, Named("DSAct") = dsact,
+                      Named("SPhat") = sphat, Named("DEPSum") = depsum,
+                      Named("SD") = SD, Named("SD2") = SD2);
 }
+#endif
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "pdsi_mc.h"
+#include "pdsi_threads.h"
+
+// The number of sets of each thread calculated before they are added to the
+// summaries
+#define MC_SETS_PER_THREAD 16
+// Up to this number of sets, every set fits in the first block and the
+// quantiles are calculated exactly from it
+#define MC_EXACT_SETS 256
+// The number of periods a thread takes at a time to add to the summaries
+#define MC_PERIODS_PER_TAKE 16
+
+// The p quantile of the n sorted values x, interpolated between them as
+// quantile(type = 7) in R
+static number mc_type7(const number *x, int n, number p) {
+  number h = (n - 1) * p;
+  int lo = (int)floor(h);
+  if(lo >= n - 1)
+    return x[n - 1];
+  return x[lo] + (h - lo) * (x[lo + 1] - x[lo]);
+}
+
+//-----------------------------------------------------------------------------
+// mc_quantile estimates the p quantile of a stream of values with the five
+// markers of the P-square algorithm.  Until five values have been seen they
+// are kept in q, and the quantile is exact.  So are the quantiles 0 and 1,
+// the extreme markers, which track the minimum and the maximum.
+//-----------------------------------------------------------------------------
+struct mc_quantile {
+  number p;
+  int count;
+  number q[5];   // Marker heights
+  number n[5];   // Marker positions
+  number ns[5];  // Desired marker positions
+  number dn[5];  // Increments of the desired positions
+
+  void init(number prob);
+  void add(number x);
+  number value() const;
+};
+
+void mc_quantile::init(number prob) {
+  p = prob;
+  count = 0;
+}
+
+void mc_quantile::add(number x) {
+  int i, k;
+
+  if(count < 5) {
+    // keep the first values sorted
+    for(i = count; i > 0 && q[i - 1] > x; i--)
+      q[i] = q[i - 1];
+    q[i] = x;
+    count++;
+    if(count == 5) {
+      for(i = 0; i < 5; i++)
+        n[i] = i;
+      ns[0] = 0;
+      ns[1] = 2 * p;
+      ns[2] = 4 * p;
+      ns[3] = 2 + 2 * p;
+      ns[4] = 4;
+      dn[0] = 0;
+      dn[1] = p / 2;
+      dn[2] = p;
+      dn[3] = (1 + p) / 2;
+      dn[4] = 1;
+    }
+    return;
+  }
+  count++;
+
+  // the cell of x, moving the extreme markers if it is beyond them
+  if(x < q[0]) {
+    q[0] = x;
+    k = 0;
+  } else if(x >= q[4]) {
+    q[4] = x;
+    k = 3;
+  } else {
+    for(k = 0; k < 3 && x >= q[k + 1]; k++)
+      ;
+  }
+  for(i = k + 1; i < 5; i++)
+    n[i] += 1;
+  for(i = 0; i < 5; i++)
+    ns[i] += dn[i];
+
+  // move the middle markers towards their desired positions
+  for(i = 1; i < 4; i++) {
+    number dev = ns[i] - n[i];
+    if((dev >= 1 && n[i + 1] - n[i] > 1) ||
+       (dev <= -1 && n[i - 1] - n[i] < -1)) {
+      int s = dev > 0 ? 1 : -1;
+      number qp = q[i] + s / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+      if(q[i - 1] < qp && qp < q[i + 1])
+        q[i] = qp;
+      else
+        q[i] = q[i] + s * (q[i + s] - q[i]) / (n[i + s] - n[i]);
+      n[i] += s;
+    }
+  }
+}
+
+number mc_quantile::value() const {
+  if(count == 0)
+    return MISSING;
+  if(count < 5)
+    return mc_type7(q, count, p);
+  if(p <= 0)
+    return q[0];
+  if(p >= 1)
+    return q[4];
+  return q[2];
+}
+
+// The running summary of one series of one period
+struct mc_stat {
+  int n;
+  number mean;
+  number m2;
+};
+
+// The state shared by the threads of pdsi_run_mc
+struct mc_run {
+  const pdsi_mc *m;
+  int block;                  // sets of a full block
+  int first;                  // first set of the block
+  int nblock;                 // sets in the block
+  int error;                  // the status of the first set that failed
+  bool exact;                 // all the sets are in the first block
+  std::vector<number> vals;   // the series of the block, set x var x np
+  std::vector<int> status;    // the status of each set of the block
+  std::vector<mc_stat> stats; // var x np
+  std::vector<mc_quantile> quant; // (var x np) x nprobs, unless exact
+  std::vector<number> exact_q;    // (var x np) x nprobs, if exact
+};
+
+static const int mc_cols[PDSI_MC_NVARS] = {
+  pdsi::V_X, pdsi::V_PHDI, pdsi::V_WPLM, pdsi::V_Z
+};
+
+// Calculates the sets of the block taken from next with the workspace PDSI.
+static void mc_calc_worker(mc_run &r, pdsi *PDSI, std::atomic<int> &next) {
+  const pdsi_mc &m = *r.m;
+  for(int b = next.fetch_add(1); b < r.nblock; b = next.fetch_add(1)) {
+    const number *set = m.sets + r.first + b;
+    try {
+      PDSI->Rext_set_parcoefs(set[0], set[m.nsets], set[2 * m.nsets],
+                              set[3 * m.nsets], set[4 * m.nsets],
+                              set[5 * m.nsets]);
+      r.status[b] = PDSI->PDSI_mon_index(m.sc);
+    } catch(std::bad_alloc &) {
+      r.status[b] = PDSI_ERR_MEMORY;
+    }
+    if(r.status[b] != PDSI_OK)
+      continue;
+    for(int v = 0; v < PDSI_MC_NVARS; v++)
+      std::copy(PDSI->vals[mc_cols[v]], PDSI->vals[mc_cols[v]] + m.np,
+                r.vals.begin() + ((size_t)b * PDSI_MC_NVARS + v) * m.np);
+  }
+}
+
+// Adds the block to the summaries of the periods taken from next,
+// MC_PERIODS_PER_TAKE at a time.  When the block holds every set, the
+// quantiles are taken exactly from the values of each period, sorted in
+// sorted, which has room for a block.
+static void mc_stat_worker(mc_run &r, std::atomic<int> &next,
+                           number *sorted) {
+  const pdsi_mc &m = *r.m;
+  for(int lo = next.fetch_add(MC_PERIODS_PER_TAKE); lo < m.np;
+      lo = next.fetch_add(MC_PERIODS_PER_TAKE)) {
+    int hi = min(lo + MC_PERIODS_PER_TAKE, m.np);
+    for(int v = 0; v < PDSI_MC_NVARS; v++) {
+      for(int i = lo; i < hi; i++) {
+        size_t vi = (size_t)v * m.np + i;
+        mc_stat &s = r.stats[vi];
+        int ns = 0;
+        for(int b = 0; b < r.nblock; b++) {
+          number x = r.vals[((size_t)b * PDSI_MC_NVARS + v) * m.np + i];
+          if(x == MISSING)
+            continue;
+          // Welford's update of the mean and the sum of squares
+          s.n++;
+          number delta = x - s.mean;
+          s.mean += delta / s.n;
+          s.m2 += delta * (x - s.mean);
+          if(r.exact) {
+            sorted[ns++] = x;
+          } else {
+            mc_quantile *q = &r.quant[vi * m.nprobs];
+            for(int j = 0; j < m.nprobs; j++)
+              q[j].add(x);
+          }
+        }
+        if(r.exact) {
+          std::sort(sorted, sorted + ns);
+          for(int j = 0; j < m.nprobs; j++)
+            r.exact_q[vi * m.nprobs + j] =
+              ns > 0 ? mc_type7(sorted, ns, m.probs[j]) : MISSING;
+        }
+      }
+    }
+  }
+}
+
+// Each thread calculates its share of each block, then adds its share of
+// the periods of the block to the summaries.  The threads wait for each
+// other between the two, and the last to finish a step sets up the next.
+static void mc_worker(mc_run &r, pdsi *PDSI, number *sorted,
+                      std::atomic<int> &next_set,
+                      std::atomic<int> &next_period, pdsi_barrier &sync) {
+  const pdsi_mc &m = *r.m;
+  while(r.first < m.nsets) {
+    mc_calc_worker(r, PDSI, next_set);
+    sync.wait([&] {
+      for(int b = 0; b < r.nblock && r.error == PDSI_OK; b++)
+        r.error = r.status[b];
+      next_period = 0;
+    });
+    if(r.error != PDSI_OK)
+      return;
+
+    mc_stat_worker(r, next_period, sorted);
+    sync.wait([&] {
+      r.first += r.nblock;
+      r.nblock = min(r.block, m.nsets - r.first);
+      next_set = 0;
+    });
+  }
+}
+
+int pdsi_run_mc(const pdsi_mc &m, int nthreads) {
+  nthreads = pdsi_num_threads(nthreads, m.nsets);
+
+  mc_run r;
+  std::vector<pdsi> ws;
+  std::vector<number> sorted;
+  // the first block holds every set of a small run whatever the threads, so
+  // that whether the quantiles are exact does not depend on them
+  r.block = std::max(MC_SETS_PER_THREAD * nthreads, MC_EXACT_SETS);
+  r.exact = m.nsets <= MC_EXACT_SETS;
+  try {
+    ws.resize(nthreads);
+    for(int t = 0; t < nthreads; t++)
+      ws[t].Copy(*m.base);
+    r.vals.resize((size_t)r.block * PDSI_MC_NVARS * m.np);
+    r.status.resize(r.block);
+    r.stats.resize((size_t)PDSI_MC_NVARS * m.np);
+    if(r.exact) {
+      r.exact_q.resize((size_t)PDSI_MC_NVARS * m.np * m.nprobs);
+      sorted.resize((size_t)nthreads * r.block);
+    } else {
+      r.quant.resize((size_t)PDSI_MC_NVARS * m.np * m.nprobs);
+    }
+  } catch(std::bad_alloc &) {
+    return PDSI_ERR_MEMORY;
+  }
+  r.m = &m;
+  for(size_t i = 0; i < r.stats.size(); i++) {
+    r.stats[i].n = 0;
+    r.stats[i].mean = r.stats[i].m2 = 0;
+  }
+  for(size_t i = 0; i < r.quant.size(); i++)
+    r.quant[i].init(m.probs[i % m.nprobs]);
+
+  // one pool of threads for all the blocks
+  r.first = 0;
+  r.nblock = min(r.block, m.nsets);
+  r.error = PDSI_OK;
+  std::atomic<int> next_set(0), next_period(0);
+  pdsi_barrier sync(nthreads);
+  pdsi_on_threads(nthreads, [&](int t) {
+    number *buf = r.exact ? &sorted[(size_t)t * r.block] : NULL;
+    mc_worker(r, &ws[t], buf, next_set, next_period, sync);
+  }, [&](int n) {
+    sync.set_count(n);
+  });
+  if(r.error != PDSI_OK)
+    return r.error;
+
+  for(int v = 0; v < PDSI_MC_NVARS; v++) {
+    number *out = m.summary[v];
+    for(int i = 0; i < m.np; i++) {
+      const mc_stat &s = r.stats[(size_t)v * m.np + i];
+      size_t qi = ((size_t)v * m.np + i) * m.nprobs;
+      out[i] = s.n > 0 ? s.mean : MISSING;
+      out[m.np + i] = s.n > 1 ? sqrt(s.m2 / (s.n - 1)) : MISSING;
+      for(int j = 0; j < m.nprobs; j++)
+        out[(size_t)(2 + j) * m.np + i] = r.exact ? r.exact_q[qi + j] :
+          r.quant[qi + j].value();
+    }
+  }
+  return PDSI_OK;
+}
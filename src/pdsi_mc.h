@@ -0,0 +1,45 @@
+#ifndef PDSI_MC_H
+#define PDSI_MC_H
+
+#include "pdsi.h"
+
+// The series summarised by pdsi_run_mc
+enum { PDSI_MC_X, PDSI_MC_PHDI, PDSI_MC_WPLM, PDSI_MC_Z, PDSI_MC_NVARS };
+
+//-----------------------------------------------------------------------------
+// pdsi_mc describes a Monte Carlo run of the index of one series over many
+// sets of the coefficients of Rext_set_parcoefs.  Only a summary of each
+// period is kept, so the memory used does not grow with the number of sets.
+// Every input and output is owned by the caller.
+//-----------------------------------------------------------------------------
+struct pdsi_mc {
+  // Inputs
+  const pdsi *base;       // Workspace of the series after PDSI_mon_coefs
+  const number *sets;     // K1_1, K1_2, K1_3, K2, p and q, nsets x 6
+  int nsets;
+  bool sc;
+  const number *probs;    // Probabilities of the quantiles
+  int nprobs;
+
+  // Outputs
+  int np;                 // Periods of the series, base->nPeriods
+  number *summary[PDSI_MC_NVARS]; // The mean, the standard deviation and
+                                  // the nprobs quantiles of each period of
+                                  // X, PHDI, WPLM and Z, np x (2 + nprobs),
+                                  // MISSING where no set gave a value
+};
+
+//-----------------------------------------------------------------------------
+// pdsi_run_mc calculates the index for the sets of m on nthreads threads
+// (every core when nthreads < 1), each with its own copy of m.base, a block
+// of a few sets per thread at a time, and adds each block to the summaries
+// of the periods, sharing the periods out among the threads.  The same
+// threads are used for all the blocks.  The sets are added in their order,
+// so the summaries do not depend on the number of threads.  Up to 256 sets
+// the quantiles are exact (as quantile(type = 7) in R); beyond, they are the
+// P-square estimates of Jain and Chlamtac (1985), exact only for 0 and 1.
+// Returns a pdsi_status and does not call into R.
+//-----------------------------------------------------------------------------
+int pdsi_run_mc(const pdsi_mc &m, int nthreads);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef PDSI_THREADS_H
+#define PDSI_THREADS_H
+
+// The files using this one include these headers before pdsi.h, whose min
+// macro breaks them.
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// pdsi_on_threads runs worker(t) for t = 1 to nthreads - 1 on new threads
+// and worker(0) on the calling thread, then joins them.  The workers take
+// their share from a counter, so a thread that cannot be started leaves it
+// to the others.  started(n) is called with the number of workers n before
+// worker(0) runs, e.g. to size a pdsi_barrier.
+//-----------------------------------------------------------------------------
+template<class F, class G>
+void pdsi_on_threads(int nthreads, F worker, G started) {
+  std::vector<std::thread> pool;
+  try {
+    pool.reserve(nthreads > 1 ? nthreads - 1 : 0);
+    for(int t = 1; t < nthreads; t++)
+      pool.push_back(std::thread(worker, t));
+  } catch(std::system_error &) {
+    // go on with the threads that could be started
+  } catch(std::bad_alloc &) {
+  }
+  started((int)pool.size() + 1);
+  worker(0);
+  for(size_t t = 0; t < pool.size(); t++)
+    pool[t].join();
+}
+
+template<class F>
+void pdsi_on_threads(int nthreads, F worker) {
+  pdsi_on_threads(nthreads, worker, [](int) {});
+}
+
+//-----------------------------------------------------------------------------
+// pdsi_barrier holds the workers of pdsi_on_threads until all n have called
+// wait.  The last one to arrive runs last() before any of them goes on, so
+// it can set up the next step of the work.  set_count may lower n before
+// worker(0) runs: until then no wait can complete.
+//-----------------------------------------------------------------------------
+class pdsi_barrier {
+public:
+  explicit pdsi_barrier(int n) : count(n), waiting(0), phase(0) {}
+
+  void set_count(int n) {
+    std::lock_guard<std::mutex> lock(m);
+    count = n;
+  }
+
+  template<class F>
+  void wait(F last) {
+    std::unique_lock<std::mutex> lock(m);
+    unsigned p = phase;
+    if(++waiting == count) {
+      last();
+      waiting = 0;
+      phase++;
+      cv.notify_all();
+    } else {
+      cv.wait(lock, [&] { return phase != p; });
+    }
+  }
+
+private:
+  std::mutex m;
+  std::condition_variable cv;
+  int count;
+  int waiting;
+  unsigned phase;
+};
+
+// The number of threads to use for n jobs when threads were asked for:
+// every core when threads < 1, and no more than n.
+inline int pdsi_num_threads(int threads, int n) {
+  if(threads < 1)
+    threads = (int)std::thread::hardware_concurrency();
+  if(threads > n)
+    threads = n;
+  if(threads < 1)
+    threads = 1;
+  return threads;
+}
+
+#endif
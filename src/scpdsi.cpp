@@ -1,4 +1,23 @@
+#include <new>
+#include <system_error>
+#include <thread>
+
 #include "pdsi.h"
+#include "pdsi_batch.h"
+#include "pdsi_boot.h"
+#include "pdsi_mc.h"
+
+// The results of the workspace PDSI as returned by C_pdsi, with the
+// columns bound to it in cols if not NULL.
+static List pdsi_result(pdsi &PDSI, NumericVector *cols = NULL) {
+  List vals = cols ? pdsi::Rext_vals_list(cols) : PDSI.Rext_out_vals();
+  List z = List::create(vals, PDSI.Rext_out_coefs(),
+                        PDSI.Rext_out_params(), PDSI.calib_iter);
+  // A diagnostic build also returns the verbose-mode statistics.
+  if(pdsi_diagnostics)
+    z.push_back(PDSI.Rext_out_diag());
+  return z;
+}
 
 // Main function to calculate scPDSI.
 // [[Rcpp::export]]
@@ -6,16 +25,406 @@ List C_pdsi(NumericVector P, NumericVector PE, double AWC,
               int s_yr, int e_yr, int calib_s_yr, int calib_e_yr,
               bool sc,
               double K1_1, double K1_2, double K1_3, double K2,
-              double p, double q) {
+              double p, double q, int calib_iter, double calib_tol) {
 
   pdsi PDSI;
 
+  // the results are calculated in the vectors returned
+  int np = e_yr > s_yr ? (e_yr - s_yr + 1) * 12 : 0;
+  NumericVector cols[pdsi::N_VALS];
+  number *col[pdsi::N_VALS];
+  for(int i = 0; i < pdsi::N_VALS; i++) {
+    cols[i] = NumericVector(np);
+    col[i] = cols[i].begin();
+  }
+  PDSI.BindVals(col, np);
+
   PDSI.Rext_init(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
   PDSI.Rext_set_parcoefs(K1_1, K1_2, K1_3, K2, p, q);
+  PDSI.Rext_set_calib(calib_iter, calib_tol);
 
   PDSI.Rext_PDSI_mon(sc);
 
-  List z = List::create(PDSI.vals_mat, PDSI.coefs_mat,
-                        PDSI.Rext_out_params());
-  return z;
+  return pdsi_result(PDSI, cols);
+}
+
+// Runs PDSI_mon_index of PDSI, leaving the status in st, so that it can be
+// run on a thread of its own.
+static void pdsi_index_job(pdsi &PDSI, bool sc, int &st) {
+  try {
+    st = PDSI.PDSI_mon_index(sc);
+  } catch(std::bad_alloc &) {
+    st = PDSI_ERR_MEMORY;
+  }
+}
+
+// Calculates both the scPDSI and the conventional PDSI of a series.  The
+// water balance, its coefficients and d are calculated once, then the
+// conventional PDSI goes on in a copy of the workspace on a second thread
+// (when parallel and there is more than one core) while this thread does
+// the self-calibration.  Returns the results of C_pdsi for each, as sc and
+// orig.
+// [[Rcpp::export]]
+List C_pdsi_both(NumericVector P, NumericVector PE, double AWC,
+                 int s_yr, int e_yr, int calib_s_yr, int calib_e_yr,
+                 double K1_1, double K1_2, double K1_3, double K2,
+                 double p, double q, int calib_iter, double calib_tol,
+                 bool parallel) {
+
+  pdsi SC, orig;
+
+  SC.Rext_init(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
+  SC.Rext_set_parcoefs(K1_1, K1_2, K1_3, K2, p, q);
+  SC.Rext_set_calib(calib_iter, calib_tol);
+
+  int st = SC.PDSI_mon_sums();
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+  SC.PDSI_mon_coefs();
+  orig.Copy(SC);
+
+  int orig_st = PDSI_ERR_MEMORY;
+  std::thread job;
+  if(parallel && std::thread::hardware_concurrency() > 1) {
+    try {
+      job = std::thread(pdsi_index_job, std::ref(orig), false,
+                        std::ref(orig_st));
+    } catch(std::system_error &) {
+      // done on this thread below
+    }
+  }
+  if(!job.joinable())
+    pdsi_index_job(orig, false, orig_st);
+  pdsi_index_job(SC, true, st);
+  if(job.joinable())
+    job.join();
+
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+  if(orig_st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(orig_st));
+
+  return List::create(Named("sc") = pdsi_result(SC),
+                      Named("orig") = pdsi_result(orig));
+}
+
+// Calculates the (sc)PDSI of many stations at once.  P and PE hold one
+// station per column, AWC and the calibrating years one value per station.
+// P and PE of a single column are calculated with each value of AWC.
+// The stations are shared out among threads threads (all the cores if
+// threads < 1), and X, PHDI, WPLM and Z are returned as (periods x stations)
+// matrices, the climate coefficients as a (12 x 5 x stations) array and the
+// calibrating coefficients as a (10 x stations) matrix.
+// [[Rcpp::export]]
+List C_pdsi_batch(NumericMatrix P, NumericMatrix PE, NumericVector AWC,
+                  int s_yr, int e_yr,
+                  IntegerVector calib_s_yr, IntegerVector calib_e_yr,
+                  bool sc,
+                  double K1_1, double K1_2, double K1_3, double K2,
+                  double p, double q, int calib_iter, double calib_tol,
+                  int threads) {
+  int nmon = P.nrow();
+  // a single series is calculated with each AWC
+  bool shared_input = P.ncol() == 1;
+  int nst = shared_input ? AWC.length() : P.ncol();
+
+  if(nst < 1)
+    Rf_error("No station to calculate.");
+  if(PE.nrow() != nmon || PE.ncol() != P.ncol())
+    Rf_error("Dimension of input PE (%d x %d) is not equal to input P "
+             "(%d x %d).", PE.nrow(), PE.ncol(), nmon, P.ncol());
+  if(AWC.length() != nst || calib_s_yr.length() != nst ||
+     calib_e_yr.length() != nst)
+    Rf_error("AWC and the calibrating years must have one value for "
+             "each of the %d stations.", nst);
+  if(s_yr >= e_yr)
+    Rf_error("Start year (%d) must earlier than end year (%d).", s_yr, e_yr);
+
+  int np = (e_yr - s_yr + 1) * 12;
+  NumericMatrix X(np, nst), PHDI(np, nst), WPLM(np, nst), Z(np, nst);
+  NumericVector clim_coes(12 * 5 * nst);
+  NumericMatrix calib_coes(10, nst);
+  IntegerVector iters(nst);
+  std::vector<int> status(nst), warnings(nst);
+
+  // everything the threads touch is a plain buffer
+  pdsi_batch b;
+  b.P = P.begin();
+  b.PE = PE.begin();
+  b.nmon = nmon;
+  b.nst = nst;
+  b.shared_input = shared_input;
+  b.AWC = AWC.begin();
+  b.calib_s_yr = calib_s_yr.begin();
+  b.calib_e_yr = calib_e_yr.begin();
+  b.s_yr = s_yr;
+  b.e_yr = e_yr;
+  b.sc = sc;
+  b.K1_1 = K1_1;
+  b.K1_2 = K1_2;
+  b.K1_3 = K1_3;
+  b.K2 = K2;
+  b.p = p;
+  b.q = q;
+  b.calib_iter = calib_iter;
+  b.calib_tol = calib_tol;
+  b.np = np;
+  b.X = X.begin();
+  b.PHDI = PHDI.begin();
+  b.WPLM = WPLM.begin();
+  b.Z = Z.begin();
+  b.clim_coes = clim_coes.begin();
+  b.calib_coes = calib_coes.begin();
+  b.iters = iters.begin();
+  b.status = &status[0];
+  b.warnings = &warnings[0];
+
+  if(pdsi_run_batch(b, threads) > 0) {
+    for(int i = 0; i < nst; i++)
+      if(status[i] != PDSI_OK)
+        Rf_error("Station %d: %s", i + 1, pdsi_status_message(status[i]));
+  }
+
+  int n_start = 0, n_end = 0;
+  for(int i = 0; i < nst; i++) {
+    if(warnings[i] & PDSI_WARN_CALIB_START)
+      n_start++;
+    if(warnings[i] & PDSI_WARN_CALIB_END)
+      n_end++;
+  }
+  if(n_start > 0)
+    Rf_warning("Calibrating start year of %d stations is earlier than start "
+               "year (%d), it would be set as start year.", n_start, s_yr);
+  if(n_end > 0)
+    Rf_warning("Calibrating end year of %d stations is later than end "
+               "year (%d), it would be set as end year.", n_end, e_yr);
+
+  return List::create(Named("X") = X, Named("PHDI") = PHDI,
+                      Named("WPLM") = WPLM, Named("Z") = Z,
+                      Named("clim.coes") = clim_coes,
+                      Named("calib.coes") = calib_coes,
+                      Named("calib.iter") = iters);
+}
+
+// Calculates the conventional PDSI of one series with each row of sets,
+// the coefficients K1_1, K1_2, K1_3, K2, p and q.  The water balance, its
+// coefficients and d are calculated once, and K, Z and the indices for each
+// set.  X, PHDI, WPLM and Z are returned as (periods x sets) matrices, K1
+// as a (12 x sets) matrix and the calibrating coefficients as a
+// (10 x sets) matrix, with alpha, beta, gamma and delta shared by the sets.
+// [[Rcpp::export]]
+List C_pdsi_sets(NumericVector P, NumericVector PE, double AWC,
+                 int s_yr, int e_yr, int calib_s_yr, int calib_e_yr,
+                 NumericMatrix sets) {
+  int nsets = sets.nrow();
+
+  if(nsets < 1 || sets.ncol() != 6)
+    Rf_error("The coefficient sets must be a matrix of 6 columns "
+             "(K1_1, K1_2, K1_3, K2, p and q) with at least one row.");
+
+  pdsi PDSI;
+
+  PDSI.Rext_init(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
+  int st = PDSI.PDSI_mon_sums();
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+  PDSI.PDSI_mon_coefs();
+
+  int np = PDSI.nPeriods;
+  NumericMatrix X(np, nsets), PHDI(np, nsets), WPLM(np, nsets), Z(np, nsets);
+  NumericMatrix K1(12, nsets), calib_coes(10, nsets);
+
+  for(int s = 0; s < nsets; s++) {
+    PDSI.Rext_set_parcoefs(sets(s, 0), sets(s, 1), sets(s, 2), sets(s, 3),
+                           sets(s, 4), sets(s, 5));
+    st = PDSI.PDSI_mon_index(false);
+    if(st != PDSI_OK)
+      Rf_error("%s", pdsi_status_message(st));
+
+    size_t out = (size_t)s * np;
+    std::copy(PDSI.vals[pdsi::V_X], PDSI.vals[pdsi::V_X] + np,
+              X.begin() + out);
+    std::copy(PDSI.vals[pdsi::V_PHDI], PDSI.vals[pdsi::V_PHDI] + np,
+              PHDI.begin() + out);
+    std::copy(PDSI.vals[pdsi::V_WPLM], PDSI.vals[pdsi::V_WPLM] + np,
+              WPLM.begin() + out);
+    std::copy(PDSI.vals[pdsi::V_Z], PDSI.vals[pdsi::V_Z] + np,
+              Z.begin() + out);
+    std::copy(PDSI.coefs[4], PDSI.coefs[4] + 12, K1.begin() + s * 12);
+    PDSI.GetCalibParams(calib_coes.begin() + s * 10);
+  }
+
+  NumericMatrix clim_coes = PDSI.Rext_out_coefs();
+  return List::create(Named("X") = X, Named("PHDI") = PHDI,
+                      Named("WPLM") = WPLM, Named("Z") = Z,
+                      Named("clim.coes") = clim_coes, Named("K1") = K1,
+                      Named("calib.coes") = calib_coes);
+}
+
+// Calculates the index of one series with each row of sets, the
+// coefficients K1_1, K1_2, K1_3, K2, p and q, on threads threads, sharing
+// the water balance, its coefficients and d.  Returns for X, PHDI, WPLM and
+// Z a (periods x (2 + length(probs))) matrix of the mean, the standard
+// deviation and the probs quantiles of each period over the sets.
+// [[Rcpp::export]]
+List C_pdsi_mc(NumericVector P, NumericVector PE, double AWC,
+               int s_yr, int e_yr, int calib_s_yr, int calib_e_yr,
+               NumericMatrix sets, bool sc, int calib_iter, double calib_tol,
+               NumericVector probs, int threads) {
+  int nsets = sets.nrow();
+
+  if(nsets < 1 || sets.ncol() != 6)
+    Rf_error("The coefficient sets must be a matrix of 6 columns "
+             "(K1_1, K1_2, K1_3, K2, p and q) with at least one row.");
+  for(int j = 0; j < probs.length(); j++)
+    if(!(probs[j] >= 0 && probs[j] <= 1))
+      Rf_error("The probabilities of the quantiles must be within [0, 1].");
+
+  pdsi PDSI;
+
+  PDSI.Rext_init(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
+  PDSI.Rext_set_calib(calib_iter, calib_tol);
+  int st = PDSI.PDSI_mon_sums();
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+  PDSI.PDSI_mon_coefs();
+
+  int np = PDSI.nPeriods;
+  int nprobs = probs.length();
+  NumericMatrix X(np, 2 + nprobs), PHDI(np, 2 + nprobs),
+    WPLM(np, 2 + nprobs), Z(np, 2 + nprobs);
+
+  pdsi_mc m;
+  m.base = &PDSI;
+  m.sets = sets.begin();
+  m.nsets = nsets;
+  m.sc = sc;
+  m.probs = probs.begin();
+  m.nprobs = nprobs;
+  m.np = np;
+  m.summary[PDSI_MC_X] = X.begin();
+  m.summary[PDSI_MC_PHDI] = PHDI.begin();
+  m.summary[PDSI_MC_WPLM] = WPLM.begin();
+  m.summary[PDSI_MC_Z] = Z.begin();
+
+  st = pdsi_run_mc(m, threads);
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+
+  return List::create(Named("X") = X, Named("PHDI") = PHDI,
+                      Named("WPLM") = WPLM, Named("Z") = Z);
+}
+
+// Bootstraps the self-calibration of one series.  years holds the years of
+// each replicate, one column per replicate.  The water balance is run once,
+// keeping what each year adds to the sums, and each replicate is the
+// scPDSI of the record of its years, calibrated over all of them, on
+// threads threads.  Returns the calibrating coefficients of the series and
+// of each replicate, as a 10-vector and a (10 x replicates) matrix, and
+// the passes of the self-calibration of each replicate.
+// [[Rcpp::export]]
+List C_pdsi_boot(NumericVector P, NumericVector PE, double AWC,
+                 int s_yr, int e_yr, int calib_s_yr, int calib_e_yr,
+                 double K1_1, double K1_2, double K1_3, double K2,
+                 double p, double q, int calib_iter, double calib_tol,
+                 IntegerMatrix years, int threads) {
+  int nyears = years.nrow(), nboot = years.ncol();
+
+  if(nyears < 2 || nboot < 1)
+    Rf_error("The years must be a matrix of at least 2 rows and 1 column.");
+  for(int i = 0; i < nyears * nboot; i++)
+    if(years[i] < s_yr || years[i] > e_yr)
+      Rf_error("The years must be within %d and %d.", s_yr, e_yr);
+
+  pdsi PDSI;
+
+  PDSI.Rext_init(P, PE, AWC, s_yr, e_yr, calib_s_yr, calib_e_yr);
+  PDSI.Rext_set_parcoefs(K1_1, K1_2, K1_3, K2, p, q);
+  PDSI.Rext_set_calib(calib_iter, calib_tol);
+  PDSI.keep_year_sums = true;
+  int st = PDSI.PDSI_mon_sums();
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+
+  std::vector<int> index(years.begin(), years.end());
+  for(size_t i = 0; i < index.size(); i++)
+    index[i] -= s_yr;
+  NumericMatrix calib_coes(10, nboot);
+  IntegerVector iters(nboot);
+
+  pdsi_boot b;
+  b.base = &PDSI;
+  b.years = &index[0];
+  b.nyears = nyears;
+  b.nboot = nboot;
+  b.calib_coes = calib_coes.begin();
+  b.iters = iters.begin();
+
+  st = pdsi_run_boot(b, threads);
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+
+  // the coefficients of the series itself
+  PDSI.PDSI_mon_coefs();
+  st = PDSI.PDSI_mon_index(true);
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+
+  return List::create(Named("calib.coes") = PDSI.Rext_out_params(),
+                      Named("boot") = calib_coes,
+                      Named("calib.iter") = iters);
+}
+
+// Calculates the climate coefficients of one series, alpha, beta, gamma,
+// delta and K1, for each calibrating period (calib_s_yr[i], calib_e_yr[i]).
+// The water balance is run once, and the sums of each period are taken from
+// the running sums over the years (ClimCoefs).  Returns them as a
+// (12 x 5 x periods) array.
+// [[Rcpp::export]]
+NumericVector C_pdsi_clim_coes(NumericVector P, NumericVector PE, double AWC,
+                               int s_yr, int e_yr,
+                               IntegerVector calib_s_yr,
+                               IntegerVector calib_e_yr,
+                               double K1_1, double K1_2, double K1_3) {
+  int nwin = calib_s_yr.length();
+
+  if(nwin < 1 || calib_e_yr.length() != nwin)
+    Rf_error("The calibrating start and end years must have the same "
+             "number of values.");
+
+  pdsi PDSI;
+
+  PDSI.Rext_init(P, PE, AWC, s_yr, e_yr, s_yr, e_yr);
+  // only K1 of the coefficients is used
+  PDSI.Rext_set_parcoefs(K1_1, K1_2, K1_3, PDSI.coe_K2, PDSI.coe_p,
+                         PDSI.coe_q);
+  PDSI.keep_year_sums = true;
+  int st = PDSI.PDSI_mon_sums();
+  if(st != PDSI_OK)
+    Rf_error("%s", pdsi_status_message(st));
+  PDSI.CumYearSums();
+
+  NumericVector clim_coes(12 * 5 * nwin);
+  int n_start = 0, n_end = 0;
+  for(int i = 0; i < nwin; i++) {
+    st = PDSI.ClimCoefs(calib_s_yr[i], calib_e_yr[i]);
+    if(st != PDSI_OK)
+      Rf_error("Calibrating period %d: %s", i + 1, pdsi_status_message(st));
+    if(PDSI.warnings & PDSI_WARN_CALIB_START)
+      n_start++;
+    if(PDSI.warnings & PDSI_WARN_CALIB_END)
+      n_end++;
+    for(int j = 0; j < 5; j++)
+      std::copy(PDSI.coefs[j], PDSI.coefs[j] + 12,
+                clim_coes.begin() + (size_t)i * 60 + j * 12);
+  }
+
+  if(n_start > 0)
+    Rf_warning("Calibrating start year of %d periods is earlier than start "
+               "year (%d), it would be set as start year.", n_start, s_yr);
+  if(n_end > 0)
+    Rf_warning("Calibrating end year of %d periods is later than end "
+               "year (%d), it would be set as end year.", n_end, e_yr);
+
+  return clim_coes;
 }
@@ -0,0 +1,168 @@
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "pdsi.h"
+#include "wb_lanes.h"
+
+static void wb_sum_scalar(const wb_block &b) {
+  wb_sum_lanes<wb_lanes<1> >(b);
+}
+
+// Picks the kernel of wb_lanes_isa, see wb_lanes.h.
+static wb_isa wb_choose_isa() {
+  wb_isa isa[3] = {
+    {"avx512", 8, wb_lanes_avx512()},
+    {"avx2", 4, wb_lanes_avx2()},
+    {"scalar", 1, wb_sum_scalar}
+  };
+
+  // A kernel is built only where the compiler has these builtins.
+  // __builtin_cpu_init is needed before main.
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+  __builtin_cpu_init();
+  if(!__builtin_cpu_supports("avx512f"))
+    isa[0].sum = 0;
+  if(!__builtin_cpu_supports("avx2"))
+    isa[1].sum = 0;
+#endif
+#endif
+
+  const char *forced = getenv("SCPDSI_ISA");
+  if(forced)
+    for(int i = 0; i < 3; i++)
+      if(isa[i].sum && strcmp(forced, isa[i].name) == 0)
+        return isa[i];
+  for(int i = 0; i < 3; i++)
+    if(isa[i].sum)
+      return isa[i];
+  return isa[2];
+}
+
+static const wb_isa wb_isa_loaded = wb_choose_isa();
+
+const wb_isa &wb_lanes_isa() {
+  return wb_isa_loaded;
+}
+
+//-----------------------------------------------------------------------------
+// SumAllLanes does what SumAll does for the monthly series loaded into up to
+// isa.width workspaces, one per lane, with the water balance of every lane
+// run by the kernel isa.sum.  ws[l] is the workspace of lane l, or NULL for
+// an unused lane.  Every workspace must have been through Load and
+// PDSI_mon_setup for nyears years.  The input is moved into the interleaved
+// series of a wb_block in work, and the results are moved back into the
+// workspaces, which then go on with PDSI_mon_finish.  The results are the
+// same as with SumAll.
+//-----------------------------------------------------------------------------
+void pdsi::SumAllLanes(pdsi *const *ws, int nyears, const wb_isa &isa,
+                       std::vector<number> &work) {
+  const int W = isa.width;
+  const int np = nyears * 12;
+  const size_t nw = (size_t)np * W;
+  number in[12];
+
+  work.resize(nw * 8 + (size_t)(WB_N_SUMS * 12 + 5) * W);
+  number *p = &work[0];
+  number *P = p, *PE = p + nw, *L = p + 7 * nw, *sums = p + 8 * nw;
+  number *AWC_l = sums + WB_N_SUMS * 12 * W;
+  number *skip = AWC_l + W, *left = skip + W, *ss = left + W, *su = ss + W;
+
+  wb_block b;
+  b.width = W;
+  b.nyears = nyears;
+  b.P = P;
+  b.PE = PE;
+  b.AWC = AWC_l;
+  b.skip = skip;
+  b.left = left;
+  b.Ss = ss;
+  b.Su = su;
+  for(int i = 0; i < 5; i++)
+    b.col[i] = p + (2 + i) * nw;
+  b.L = pdsi_diagnostics ? L : NULL;
+  b.sums = sums;
+
+  for(int l = 0; l < W; l++) {
+    if(!ws[l]) {
+      // an unused lane only sees missing months
+      AWC_l[l] = 1.0;
+      ss[l] = 1.0;
+      su[l] = 0.0;
+      skip[l] = nyears;
+      left[l] = 0;
+      for(int n = 0; n < np; n++)
+        P[n * W + l] = PE[n * W + l] = MISSING;
+      continue;
+    }
+    AWC_l[l] = ws[l]->AWC;
+    ss[l] = ws[l]->Ss;
+    su[l] = ws[l]->Su;
+    skip[l] = ws[l]->nStartYearsToSkip;
+    left[l] = ws[l]->nCalibrationPeriods;
+    if(l > 0 && ws[l - 1] && ws[l - 1]->P_in == ws[l]->P_in &&
+       ws[l - 1]->PE_in == ws[l]->PE_in &&
+       ws[l - 1]->input_len == ws[l]->input_len &&
+       ws[l - 1]->metric == ws[l]->metric) {
+      // the same series as the lane before, as in an AWC sweep
+      for(int n = 0; n < np; n++) {
+        P[n * W + l] = P[n * W + l - 1];
+        PE[n * W + l] = PE[n * W + l - 1];
+      }
+      continue;
+    }
+    for(int year = 1; year <= nyears; year++) {
+      int n = (year - 1) * 12;
+      ws[l]->GetInput(ws[l]->PE_in, year, in, 12);
+      for(int per = 0; per < 12; per++)
+        PE[(n + per) * W + l] = in[per];
+      ws[l]->GetInput(ws[l]->P_in, year, in, 12);
+      for(int per = 0; per < 12; per++)
+        P[(n + per) * W + l] = in[per];
+    }
+  }
+
+  isa.sum(b);
+
+  // Hand the results, the sums and the soil moisture back to the workspaces
+  for(int l = 0; l < W; l++) {
+    if(!ws[l])
+      continue;
+    for(int i = 0; i < 5; i++)
+      for(int n = 0; n < np; n++)
+        ws[l]->vals[V_P + i][n] = b.col[i][n * W + l];
+    for(int per = 0; per < 12; per++) {
+      ws[l]->ETSum[per] = sums[(WB_S_ET * 12 + per) * W + l];
+      ws[l]->RSum[per] = sums[(WB_S_R * 12 + per) * W + l];
+      ws[l]->ROSum[per] = sums[(WB_S_RO * 12 + per) * W + l];
+      ws[l]->LSum[per] = sums[(WB_S_L * 12 + per) * W + l];
+      ws[l]->PSum[per] = sums[(WB_S_P * 12 + per) * W + l];
+      ws[l]->PESum[per] = sums[(WB_S_PE * 12 + per) * W + l];
+      ws[l]->PRSum[per] = sums[(WB_S_PR * 12 + per) * W + l];
+      ws[l]->PROSum[per] = sums[(WB_S_PRO * 12 + per) * W + l];
+      ws[l]->PLSum[per] = sums[(WB_S_PL * 12 + per) * W + l];
+    }
+    ws[l]->Ss = ss[l];
+    ws[l]->Su = su[l];
+
+    // The statistics of the most verbose mode, as in SumAll
+    ws[l]->SD = 0;
+    ws[l]->SD2 = 0;
+    if(pdsi_diagnostics) {
+      number DEP = 0;
+      for(int n = 0; n < np; n++) {
+        int per = n % 12;
+        number P_n = b.col[V_P][n * W + l];
+        if(P_n == MISSING || per < 5 || per > 7)
+          continue;
+        DEP = DEP + P_n + L[n * W + l] - b.col[V_PE][n * W + l];
+        if(per == 7) {
+          ws[l]->SD = ws[l]->SD + DEP;
+          ws[l]->SD2 = ws[l]->SD2 + DEP * DEP;
+          DEP = 0;
+        }
+      }
+    }
+  }
+}
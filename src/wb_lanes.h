@@ -0,0 +1,214 @@
+#ifndef WB_LANES_H
+#define WB_LANES_H
+
+// This header is also compiled for other instruction sets by the
+// wb_lanes_*.cpp files, so it includes nothing but wb_step.h: an inline
+// function of a library header built there could be linked into code that
+// runs on any CPU.
+#include "wb_step.h"
+
+typedef double number;
+#ifndef MISSING
+#define MISSING -999.00
+#endif
+
+//-----------------------------------------------------------------------------
+// Vectors of water balance values with one station per lane, so that
+// wb_step can run the water balance of several stations at once.  Each has
+// the arithmetic wb_step uses, comparisons giving a mask, & on masks and a
+// wb_select overload on the mask.  Lanes whose comparisons are false for a
+// NaN behave like the scalar comparisons.
+//
+// wb_lanes<W> is the portable version of W lanes.  wb_v4d (AVX2) and wb_v8d
+// (AVX-512) are defined in wb_lanes_avx2.cpp and wb_lanes_avx512.cpp, which
+// are compiled for those instruction sets whatever the flags of the rest of
+// the package (except on Windows), and one of them is picked when the
+// package is loaded (see wb_lanes_isa).  Without either, the water balance
+// runs with a single lane: all the branches wb_step evaluates cost more
+// than the portable lanes save.
+//-----------------------------------------------------------------------------
+template<int W>
+struct wb_lanes_mask {
+  bool m[W];
+};
+
+template<int W>
+inline wb_lanes_mask<W> operator&(const wb_lanes_mask<W> &a,
+                                  const wb_lanes_mask<W> &b) {
+  wb_lanes_mask<W> r;
+  for(int i = 0; i < W; i++)
+    r.m[i] = a.m[i] && b.m[i];
+  return r;
+}
+
+template<int W>
+struct wb_lanes {
+  enum { width = W };
+  typedef wb_lanes_mask<W> mask;
+  number v[W];
+
+  wb_lanes() {}
+  wb_lanes(number x) {
+    for(int i = 0; i < W; i++)
+      v[i] = x;
+  }
+  static wb_lanes load(const number *p) {
+    wb_lanes r;
+    for(int i = 0; i < W; i++)
+      r.v[i] = p[i];
+    return r;
+  }
+  void store(number *p) const {
+    for(int i = 0; i < W; i++)
+      p[i] = v[i];
+  }
+};
+
+#define WB_LANES_OP(op)                                                     \
+  template<int W>                                                           \
+  inline wb_lanes<W> operator op(const wb_lanes<W> &a, const wb_lanes<W> &b) { \
+    wb_lanes<W> r;                                                          \
+    for(int i = 0; i < W; i++)                                              \
+      r.v[i] = a.v[i] op b.v[i];                                            \
+    return r;                                                               \
+  }
+WB_LANES_OP(+)
+WB_LANES_OP(-)
+WB_LANES_OP(*)
+WB_LANES_OP(/)
+#undef WB_LANES_OP
+
+#define WB_LANES_CMP(op)                                                    \
+  template<int W>                                                           \
+  inline wb_lanes_mask<W> operator op(const wb_lanes<W> &a,                 \
+                                      const wb_lanes<W> &b) {               \
+    wb_lanes_mask<W> r;                                                     \
+    for(int i = 0; i < W; i++)                                              \
+      r.m[i] = a.v[i] op b.v[i];                                            \
+    return r;                                                               \
+  }
+WB_LANES_CMP(<)
+WB_LANES_CMP(>)
+WB_LANES_CMP(<=)
+WB_LANES_CMP(>=)
+WB_LANES_CMP(!=)
+#undef WB_LANES_CMP
+
+template<int W>
+inline wb_lanes<W> wb_select(const wb_lanes_mask<W> &c, const wb_lanes<W> &a,
+                             const wb_lanes<W> &b) {
+  wb_lanes<W> r;
+  for(int i = 0; i < W; i++)
+    r.v[i] = c.m[i] ? a.v[i] : b.v[i];
+  return r;
+}
+
+//-----------------------------------------------------------------------------
+// wb_block is the water balance of a block of stations, one per lane, over
+// nyears years of 12 months.  The monthly series are interleaved: month n
+// of lane l is at [n * width + l].  The calibration sums are at
+// [(k * 12 + per) * width + l] for sum k (WB_S_ET ...) of period per.
+//-----------------------------------------------------------------------------
+enum { WB_S_ET, WB_S_R, WB_S_RO, WB_S_L, WB_S_P, WB_S_PE, WB_S_PR, WB_S_PRO,
+       WB_S_PL, WB_N_SUMS };
+
+struct wb_block {
+  int width;
+  int nyears;
+  const number *P;   // precipitation, MISSING where missing
+  const number *PE;  // potential evapotranspiration
+  const number *AWC; // available water capacity of each lane
+  const number *skip;// years to skip before the calibration interval
+  number *left;      // calibration periods left, updated
+  number *Ss;        // soil moisture of each lane, updated
+  number *Su;
+  number *col[5];    // P, PE, PR, PRO and PL, MISSING where not calculated
+  number *L;         // actual loss, or NULL when not wanted
+  number *sums;      // the sums of the calibration interval
+};
+
+//-----------------------------------------------------------------------------
+// wb_sum_lanes runs the water balance of a block with the lanes of V, in
+// the order of the scalar code of SumAll, so the results are the same.
+//-----------------------------------------------------------------------------
+template<class V>
+void wb_sum_lanes(const wb_block &b) {
+  const int W = V::width;
+  typedef typename V::mask M;
+
+  const V zero(0.0), one(1.0), missing(MISSING);
+  V sums[WB_N_SUMS][12];
+  for(int k = 0; k < WB_N_SUMS; k++)
+    for(int per = 0; per < 12; per++)
+      sums[k][per] = zero;
+  V AWC_v = V::load(b.AWC), skip_v = V::load(b.skip);
+  V left_v = V::load(b.left);
+  wb_state<V> soil;
+  soil.Ss = V::load(b.Ss);
+  soil.Su = V::load(b.Su);
+
+  for(int year = 1; year <= b.nyears; year++) {
+    V year_v((number)year);
+    for(int per = 0; per < 12; per++) {
+      int n = ((year - 1) * 12 + per) * W;
+      V P_v = V::load(b.P + n);
+      V PE_v = V::load(b.PE + n);
+      M valid = (P_v >= zero) & (PE_v != missing);
+
+      wb_result<V> wb = wb_step(P_v, PE_v, AWC_v, soil);
+      soil.Ss = wb_select(valid, wb.soil.Ss, soil.Ss);
+      soil.Su = wb_select(valid, wb.soil.Su, soil.Su);
+
+      // the calibration interval counts only the months with data
+      M cal = valid & (year_v > skip_v) & (left_v > zero);
+      left_v = left_v - wb_select(cal, one, zero);
+      sums[WB_S_ET][per] = sums[WB_S_ET][per] + wb_select(cal, wb.ET, zero);
+      sums[WB_S_R][per] = sums[WB_S_R][per] + wb_select(cal, wb.R, zero);
+      sums[WB_S_RO][per] = sums[WB_S_RO][per] + wb_select(cal, wb.RO, zero);
+      sums[WB_S_L][per] = sums[WB_S_L][per] + wb_select(cal, wb.L, zero);
+      sums[WB_S_P][per] = sums[WB_S_P][per] + wb_select(cal, P_v, zero);
+      sums[WB_S_PE][per] = sums[WB_S_PE][per] + wb_select(cal, PE_v, zero);
+      sums[WB_S_PR][per] = sums[WB_S_PR][per] + wb_select(cal, wb.PR, zero);
+      sums[WB_S_PRO][per] = sums[WB_S_PRO][per] +
+        wb_select(cal, wb.PRO, zero);
+      sums[WB_S_PL][per] = sums[WB_S_PL][per] + wb_select(cal, wb.PL, zero);
+
+      wb_select(valid, P_v, missing).store(b.col[0] + n);
+      wb_select(valid, PE_v, missing).store(b.col[1] + n);
+      wb_select(valid, wb.PR, missing).store(b.col[2] + n);
+      wb_select(valid, wb.PRO, missing).store(b.col[3] + n);
+      wb_select(valid, wb.PL, missing).store(b.col[4] + n);
+      if(b.L)
+        wb.L.store(b.L + n);
+    }
+  }
+
+  soil.Ss.store(b.Ss);
+  soil.Su.store(b.Su);
+  left_v.store(b.left);
+  for(int k = 0; k < WB_N_SUMS; k++)
+    for(int per = 0; per < 12; per++)
+      sums[k][per].store(b.sums + (k * 12 + per) * W);
+}
+
+//-----------------------------------------------------------------------------
+// The water balance kernel of an instruction set and its number of lanes.
+// wb_lanes_avx512 and wb_lanes_avx2 return their kernel, or NULL where the
+// compiler cannot build it.  wb_lanes_isa is the one picked when the
+// package is loaded: the widest the CPU supports, unless the environment
+// variable SCPDSI_ISA names another one ("avx512", "avx2" or "scalar") that
+// it supports, which is meant for benchmarking.
+//-----------------------------------------------------------------------------
+typedef void (*wb_kernel)(const wb_block &b);
+
+struct wb_isa {
+  const char *name;
+  int width;
+  wb_kernel sum;
+};
+
+wb_kernel wb_lanes_avx512();
+wb_kernel wb_lanes_avx2();
+const wb_isa &wb_lanes_isa();
+
+#endif
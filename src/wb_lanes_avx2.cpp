@@ -0,0 +1,99 @@
+//-----------------------------------------------------------------------------
+// The water balance kernel with four lanes in an AVX2 register.  Everything
+// after the target pragma is compiled for AVX2, whatever the flags of the
+// rest of the package, and only runs when wb_lanes_isa has found it on the
+// CPU.  FMA is not enabled, so the results are the same as the scalar code.
+//-----------------------------------------------------------------------------
+// Not on Windows, where MinGW-w64 GCC does not align the stack for the
+// spills of AVX registers (GCC bug 54412).
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define WB_LANES_AVX2
+#endif
+#endif
+
+#ifdef WB_LANES_AVX2
+#include <immintrin.h>
+
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx2"))), \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include "wb_lanes.h"
+
+// Four doubles in an AVX register.  The mask is all ones in a true lane.
+struct wb_m4d {
+  __m256d m;
+};
+
+struct wb_v4d {
+  enum { width = 4 };
+  typedef wb_m4d mask;
+  __m256d v;
+
+  wb_v4d() {}
+  wb_v4d(number x) : v(_mm256_set1_pd(x)) {}
+  wb_v4d(__m256d x) : v(x) {}
+  static wb_v4d load(const number *p) { return wb_v4d(_mm256_loadu_pd(p)); }
+  void store(number *p) const { _mm256_storeu_pd(p, v); }
+};
+
+inline wb_v4d operator+(const wb_v4d &a, const wb_v4d &b) {
+  return wb_v4d(_mm256_add_pd(a.v, b.v));
+}
+inline wb_v4d operator-(const wb_v4d &a, const wb_v4d &b) {
+  return wb_v4d(_mm256_sub_pd(a.v, b.v));
+}
+inline wb_v4d operator*(const wb_v4d &a, const wb_v4d &b) {
+  return wb_v4d(_mm256_mul_pd(a.v, b.v));
+}
+inline wb_v4d operator/(const wb_v4d &a, const wb_v4d &b) {
+  return wb_v4d(_mm256_div_pd(a.v, b.v));
+}
+#define WB_V4D_CMP(op, imm)                                                 \
+  inline wb_m4d operator op(const wb_v4d &a, const wb_v4d &b) {             \
+    wb_m4d r;                                                               \
+    r.m = _mm256_cmp_pd(a.v, b.v, imm);                                     \
+    return r;                                                               \
+  }
+WB_V4D_CMP(<, _CMP_LT_OQ)
+WB_V4D_CMP(>, _CMP_GT_OQ)
+WB_V4D_CMP(<=, _CMP_LE_OQ)
+WB_V4D_CMP(>=, _CMP_GE_OQ)
+WB_V4D_CMP(!=, _CMP_NEQ_UQ)
+#undef WB_V4D_CMP
+
+inline wb_m4d operator&(const wb_m4d &a, const wb_m4d &b) {
+  wb_m4d r;
+  r.m = _mm256_and_pd(a.m, b.m);
+  return r;
+}
+
+inline wb_v4d wb_select(const wb_m4d &c, const wb_v4d &a, const wb_v4d &b) {
+  return wb_v4d(_mm256_blendv_pd(b.v, a.v, c.m));
+}
+
+static void wb_sum_avx2(const wb_block &b) {
+  wb_sum_lanes<wb_v4d>(b);
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+wb_kernel wb_lanes_avx2() {
+  return wb_sum_avx2;
+}
+#else
+#include "wb_lanes.h"
+
+wb_kernel wb_lanes_avx2() {
+  return 0;
+}
+#endif
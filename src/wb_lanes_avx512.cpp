@@ -0,0 +1,100 @@
+//-----------------------------------------------------------------------------
+// The water balance kernel with eight lanes in an AVX-512 register.
+// Everything after the target pragma is compiled for AVX-512F, whatever the
+// flags of the rest of the package, and only runs when wb_lanes_isa has
+// found it on the CPU.  FMA is not enabled, so the results are the same as
+// the scalar code.
+//-----------------------------------------------------------------------------
+// Not on Windows, where MinGW-w64 GCC does not align the stack for the
+// spills of AVX-512 registers (GCC bug 54412).
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define WB_LANES_AVX512
+#endif
+#endif
+
+#ifdef WB_LANES_AVX512
+#include <immintrin.h>
+
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx512f"))), \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+#include "wb_lanes.h"
+
+// Eight doubles in an AVX-512 register, with a mask register as the mask.
+struct wb_m8d {
+  __mmask8 m;
+};
+
+struct wb_v8d {
+  enum { width = 8 };
+  typedef wb_m8d mask;
+  __m512d v;
+
+  wb_v8d() {}
+  wb_v8d(number x) : v(_mm512_set1_pd(x)) {}
+  wb_v8d(__m512d x) : v(x) {}
+  static wb_v8d load(const number *p) { return wb_v8d(_mm512_loadu_pd(p)); }
+  void store(number *p) const { _mm512_storeu_pd(p, v); }
+};
+
+inline wb_v8d operator+(const wb_v8d &a, const wb_v8d &b) {
+  return wb_v8d(_mm512_add_pd(a.v, b.v));
+}
+inline wb_v8d operator-(const wb_v8d &a, const wb_v8d &b) {
+  return wb_v8d(_mm512_sub_pd(a.v, b.v));
+}
+inline wb_v8d operator*(const wb_v8d &a, const wb_v8d &b) {
+  return wb_v8d(_mm512_mul_pd(a.v, b.v));
+}
+inline wb_v8d operator/(const wb_v8d &a, const wb_v8d &b) {
+  return wb_v8d(_mm512_div_pd(a.v, b.v));
+}
+#define WB_V8D_CMP(op, imm)                                                 \
+  inline wb_m8d operator op(const wb_v8d &a, const wb_v8d &b) {             \
+    wb_m8d r;                                                               \
+    r.m = _mm512_cmp_pd_mask(a.v, b.v, imm);                                \
+    return r;                                                               \
+  }
+WB_V8D_CMP(<, _CMP_LT_OQ)
+WB_V8D_CMP(>, _CMP_GT_OQ)
+WB_V8D_CMP(<=, _CMP_LE_OQ)
+WB_V8D_CMP(>=, _CMP_GE_OQ)
+WB_V8D_CMP(!=, _CMP_NEQ_UQ)
+#undef WB_V8D_CMP
+
+inline wb_m8d operator&(const wb_m8d &a, const wb_m8d &b) {
+  wb_m8d r;
+  r.m = (__mmask8)(a.m & b.m);
+  return r;
+}
+
+inline wb_v8d wb_select(const wb_m8d &c, const wb_v8d &a, const wb_v8d &b) {
+  return wb_v8d(_mm512_mask_blend_pd(c.m, b.v, a.v));
+}
+
+static void wb_sum_avx512(const wb_block &b) {
+  wb_sum_lanes<wb_v8d>(b);
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+wb_kernel wb_lanes_avx512() {
+  return wb_sum_avx512;
+}
+#else
+#include "wb_lanes.h"
+
+wb_kernel wb_lanes_avx512() {
+  return 0;
+}
+#endif
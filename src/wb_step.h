@@ -0,0 +1,108 @@
+#ifndef WB_STEP_H
+#define WB_STEP_H
+
+//-----------------------------------------------------------------------------
+// The water balance of one period as a pure function of the soil moisture.
+// Every branch of the original CalcPL/CalcActual is evaluated and the result
+// picked by wb_select, so that T can be a scalar or a vector of lanes (one
+// cell per lane) that brings its own comparisons and wb_select overload.
+// The arithmetic of each branch is the same as in the original, so the
+// scalar results are identical.
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// wb_select returns a where c holds, and b otherwise.
+//-----------------------------------------------------------------------------
+template<class T>
+inline T wb_select(bool c, const T &a, const T &b) {
+  return c ? a : b;
+}
+
+// wb_state is the moisture held in the surface (Ss) and the underlying (Su)
+// layer of the soil.
+template<class T>
+struct wb_state {
+  T Ss;
+  T Su;
+};
+
+// wb_result holds the potential and actual values of one period, and the
+// soil moisture left for the next period.
+template<class T>
+struct wb_result {
+  T PR;             // Potential Recharge
+  T PRO;            // Potential Runoff
+  T PL;             // Potential Loss
+  T ET;             // Actual Evapotranspiration
+  T R;              // Actual Recharge
+  T L;              // Actual Loss
+  T RO;             // Actual Runoff
+  wb_state<T> soil; // Soil moisture at the end of the period
+};
+
+//-----------------------------------------------------------------------------
+// wb_PL is the Potential Loss.  If the Ss capacity is enough to handle all
+// PE, PL is simple PE.  Otherwise PL = Su*(PE - Ss)/AWC + Ss, but no more
+// than the water in the soil (PRO).
+//-----------------------------------------------------------------------------
+template<class T>
+inline T wb_PL(const T &PE, const T &AWC, const wb_state<T> &s) {
+  T PRO = s.Ss + s.Su;
+  T PL = ((PE - s.Ss) * s.Su) / (AWC) + s.Ss;
+  PL = wb_select(PL > PRO, PRO, PL);
+  return wb_select(s.Ss >= PE, PE, PL);
+}
+
+//-----------------------------------------------------------------------------
+// wb_step calculates the potential values, the actual evapotranspiration,
+// recharge, runoff and loss of a period with precipitation P and potential
+// evapotranspiration PE, and the new soil moisture.  The surface layer holds
+// 1 in., so (AWC - 1.0) is the amount able to be stored in the lower layer.
+//-----------------------------------------------------------------------------
+template<class T>
+inline wb_result<T> wb_step(const T &P, const T &PE, const T &AWC,
+                            const wb_state<T> &s) {
+  const T zero(0.0);
+  const T one(1.0);
+  wb_result<T> w;
+
+  w.PR = AWC - (s.Su + s.Ss);
+  w.PRO = s.Ss + s.Su;
+  w.PL = wb_PL(PE, AWC, s);
+
+  // P >= PE: the excess recharges the surface layer first.  If it is more
+  // than the surface layer can take, the underlying layer is recharged with
+  // the rest, and whatever that cannot hold runs off.
+  T excess = P - PE;
+  T R_surface = one - s.Ss;
+  T under_room = (AWC - one) - s.Su;
+  T under_rest = P - PE - R_surface;
+  T R_under = wb_select(under_rest < under_room, under_rest, under_room);
+  T RO_wet = wb_select(under_rest < under_room, zero,
+                       P - PE - (R_surface + R_under));
+  T R_wet = wb_select(excess > R_surface, R_surface + R_under, excess);
+  T Ss_wet = wb_select(excess > R_surface, one, s.Ss + excess);
+  T Su_wet = wb_select(excess > R_surface, s.Su + R_under, s.Su);
+  RO_wet = wb_select(excess > R_surface, RO_wet, zero);
+
+  // P < PE: the surface layer loses moisture first, and the underlying layer
+  // loses at the rate of (PE - P - Ss)/AWC*Su once the surface is drained.
+  T deficit = PE - P;
+  T surface_L = wb_select(s.Ss > deficit, deficit, s.Ss);
+  T under_L = (PE - P - surface_L) * s.Su / AWC;
+  under_L = wb_select(s.Su < under_L, s.Su, under_L);
+  under_L = wb_select(s.Ss > deficit, zero, under_L);
+  T Ss_dry = wb_select(s.Ss > deficit, s.Ss - surface_L, zero);
+  T Su_dry = wb_select(s.Ss > deficit, s.Su, s.Su - under_L);
+  T L_dry = under_L + surface_L;
+
+  w.ET = wb_select(P >= PE, PE, P + L_dry);
+  w.R = wb_select(P >= PE, R_wet, zero);
+  w.L = wb_select(P >= PE, zero, L_dry);
+  w.RO = wb_select(P >= PE, RO_wet, zero);
+  w.soil.Ss = wb_select(P >= PE, Ss_wet, Ss_dry);
+  w.soil.Su = wb_select(P >= PE, Su_wet, Su_dry);
+  return w;
+}
+
+#endif